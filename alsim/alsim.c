@@ -0,0 +1,366 @@
+/**
+ * alsim.c
+ *
+ * Host-side apploader simulator and boot step profiler.
+ * This program is part of the cubeboot-tools package.
+ *
+ * The apploader is built for the host and driven the same way the IPL
+ * drives it, serving each of its requests from a disc image into a
+ * simulated MEM1 mapped at its GameCube address.
+ *
+ * Copyright (C) 2005-2006 The GameCube Linux Team
+ * Copyright (C) 2005,2006 Albert Herranz
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../include/lib.h"
+#include "../include/gcm.h"
+#include "../include/boottrace.h"
+
+#define _GNU_SOURCE
+#include <getopt.h>
+
+#define ALSIM_VERSION "V0.1-20261017"
+
+#define MEM1_ADDRESS		0x80000000UL
+#define MEM1_SIZE		(24*1024*1024)
+
+/* the IPL loads the apploader header right after bi2.bin */
+#define APPLOADER_OFFSET	0x2440
+
+/* safety net against apploaders which never finish */
+#define MAX_REQUESTS		1024
+
+const char *__progname;
+
+typedef void (*al_report_t) (char *text, ...);
+typedef void (*al_enter_t) (al_report_t report);
+typedef int (*al_load_t) (void **address, uint32_t *length, uint32_t *offset);
+typedef void *(*al_exit_t) (void);
+
+extern void al_start(void **enter, void **load, void **exit);
+
+static int verbose;
+static char *dump_file;
+
+struct alsim_stats {
+	unsigned long steps;
+	unsigned long requests;
+	unsigned long long bytes;
+	unsigned long long seek;
+	unsigned long long over_read;
+	unsigned long long re_read;
+};
+
+/*
+ * Support routines expected by the apploader.
+ * There are no caches to maintain on the host.
+ */
+void flush_dcache_range(void *start, void *stop)
+{
+}
+
+void invalidate_dcache_range(void *start, void *stop)
+{
+}
+
+void invalidate_icache_range(void *start, void *stop)
+{
+}
+
+/*
+ * A timebase running at the GameCube rate.
+ */
+unsigned long ticks(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * BOOT_TRACE_TICKS_PER_SEC +
+	       ts.tv_nsec / (1000000000 / BOOT_TRACE_TICKS_PER_SEC);
+}
+
+void panic(char *text)
+{
+	die("apploader panic: %s", text);
+}
+
+/*
+ *
+ */
+static void report(char *fmt, ...)
+{
+	va_list args;
+
+	if (!verbose)
+		return;
+
+	va_start(args, fmt);
+	printf("  al: ");
+	vprintf(fmt, args);
+	va_end(args);
+}
+
+/*
+ * Maps the simulated MEM1 at the address the apploader expects.
+ */
+static void *map_mem1(void)
+{
+	void *mem1;
+
+	mem1 = mmap((void *)MEM1_ADDRESS, MEM1_SIZE, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+	if (mem1 == MAP_FAILED || mem1 != (void *)MEM1_ADDRESS)
+		die("can't map MEM1 at 0x%08lx: %s\n", MEM1_ADDRESS,
+		    strerror(errno));
+	return mem1;
+}
+
+/*
+ * Writes the simulated MEM1 to a file.
+ */
+static void dump_mem1(const char *filename)
+{
+	FILE *fout;
+
+	fout = fopen(filename, "w");
+	if (!fout)
+		die("%s: can't open dump file: %s\n", filename, strerror(errno));
+	if (fwrite((void *)MEM1_ADDRESS, MEM1_SIZE, 1, fout) != 1)
+		die("%s: can't write dump: %s\n", filename, strerror(errno));
+	fclose(fout);
+}
+
+/*
+ * Serves one apploader request from the disc image.
+ */
+static void serve_request(void *image, off_t image_size,
+			  void *address, uint32_t length, uint32_t offset)
+{
+	unsigned long addr = (unsigned long)address;
+
+	if (offset + (off_t)length > image_size)
+		die("request past end of image (offset 0x%08x, length 0x%x)\n",
+		    offset, length);
+
+	/*
+	 * Requests either target MEM1 or, for the apploader own buffers,
+	 * host memory.
+	 */
+	if (addr >= MEM1_ADDRESS && addr < MEM1_ADDRESS + MEM1_SIZE &&
+	    addr + length > MEM1_ADDRESS + MEM1_SIZE)
+		die("request past end of MEM1 (address 0x%08lx, length 0x%x)\n",
+		    addr, length);
+
+	memcpy(address, image + offset, length);
+}
+
+/*
+ * Counts the sectors of a request already transferred before, and marks
+ * all of them as transferred.
+ */
+static unsigned long count_re_read(unsigned char *sectors_read,
+				   uint32_t offset, uint32_t length)
+{
+	unsigned long sector, first, last, count = 0;
+
+	first = offset / DI_SECTOR_SIZE;
+	last = (offset + length - 1) / DI_SECTOR_SIZE;
+	for (sector = first; sector <= last; sector++) {
+		if (sectors_read[sector / 8] & (1 << (sector % 8)))
+			count++;
+		sectors_read[sector / 8] |= 1 << (sector % 8);
+	}
+	return count;
+}
+
+/*
+ * Drives the apploader through all its steps, like the IPL does.
+ */
+static void *run_apploader(void *image, off_t image_size,
+			   struct alsim_stats *stats)
+{
+	al_enter_t al_enter;
+	al_load_t al_load;
+	al_exit_t al_exit;
+	struct gcm_apploader_header *ah;
+	unsigned char *sectors_read;
+	void *address;
+	uint32_t length, offset;
+	unsigned long long head, seek, span, over_read, re_read;
+	int need_more;
+
+	memset(stats, 0, sizeof(*stats));
+
+	sectors_read = xmalloc(image_size / DI_SECTOR_SIZE / 8 + 1);
+	memset(sectors_read, 0, image_size / DI_SECTOR_SIZE / 8 + 1);
+
+	/* the IPL leaves the disk id in lowmem before starting us */
+	memcpy((void *)MEM1_ADDRESS, image, sizeof(struct gcm_disk_info));
+
+	/* and the drive head right after the apploader */
+	ah = image + APPLOADER_OFFSET;
+	head = APPLOADER_OFFSET + sizeof(*ah) + be32_to_cpu(ah->size);
+	count_re_read(sectors_read, 0, head);
+
+	al_start((void **)&al_enter, (void **)&al_load, (void **)&al_exit);
+	al_enter(report);
+
+	printf("%4s %10s %10s %10s %10s %10s %8s\n", "req", "address",
+	       "offset", "length", "seek", "over-read", "re-read");
+	do {
+		address = NULL;
+		length = 0;
+		offset = 0;
+		need_more = al_load(&address, &length, &offset);
+		stats->steps++;
+		if (!length)
+			continue;
+
+		if (stats->requests++ >= MAX_REQUESTS)
+			die("apploader made too many requests\n");
+
+		serve_request(image, image_size, address, length, offset);
+
+		seek = (offset > head) ? offset - head : head - offset;
+		head = offset + length;
+
+		/* the drive always reads whole sectors */
+		span = ((offset + length + DI_SECTOR_SIZE - 1) /
+			DI_SECTOR_SIZE - offset / DI_SECTOR_SIZE) *
+			DI_SECTOR_SIZE;
+		over_read = span - length;
+		re_read = count_re_read(sectors_read, offset, length) *
+			  DI_SECTOR_SIZE;
+
+		printf("%4lu 0x%08lx 0x%08x %10u %10llu %10llu %8llu\n",
+		       stats->requests, (unsigned long)address, offset,
+		       length, seek, over_read, re_read);
+
+		stats->bytes += length;
+		stats->seek += seek;
+		stats->over_read += over_read;
+		stats->re_read += re_read;
+	} while (need_more);
+
+	free(sectors_read);
+
+	return al_exit();
+}
+
+/*
+ *
+ */
+void version(void)
+{
+	printf("version %s\n", ALSIM_VERSION);
+	exit(2);
+}
+
+/*
+ *
+ */
+void usage(void)
+{
+	fprintf(stderr,
+		"Usage: %s [OPTION] IMAGE" "\n"
+		"  -v, --verbose           show apploader messages" "\n"
+		"  -d, --dump=FILE         write MEM1 to file when done" "\n"
+		"  -V, --version           show version" "\n",
+		__progname);
+	exit(1);
+}
+
+/*
+ *
+ */
+int main(int argc, char *argv[])
+{
+	struct alsim_stats stats;
+	char *infile;
+	struct mapped_file mf;
+	void *image;
+	off_t image_size;
+	void *entry_point;
+	char *p;
+	int ch;
+
+	struct option long_options[] = {
+		{"verbose", 0, NULL, 'v'},
+		{"dump", 1, NULL, 'd'},
+		{"version", 0, NULL, 'V'},
+		{"help", 0, NULL, 'h'},
+		{0, 0, 0, 0}
+	};
+#define SHORT_OPTIONS "vd:Vh"
+
+	p = strrchr(argv[0], '/');
+	__progname = (p && p[1]) ? p + 1 : argv[0];
+
+	while ((ch = getopt_long(argc, argv, SHORT_OPTIONS,
+				 long_options, NULL)) != -1) {
+		switch (ch) {
+		case 'v':
+			verbose = 1;
+			break;
+		case 'd':
+			dump_file = optarg;
+			break;
+		case 'V':
+			version();
+			break;
+		case 'h':
+		case '?':
+		default:
+			usage();
+			break;
+		}
+	}
+
+	if (argc - optind != 1)
+		usage();
+	infile = argv[optind];
+
+	map_file(infile, &mf);
+	image = mf.data;
+	image_size = mf.size;
+	if (image_size < APPLOADER_OFFSET + sizeof(struct gcm_apploader_header))
+		die("%s: image too small\n", infile);
+
+	map_mem1();
+
+	entry_point = run_apploader(image, image_size, &stats);
+
+	printf("\n");
+	printf("entry point      = 0x%08lx\n", (unsigned long)entry_point);
+	printf("steps            = %lu\n", stats.steps);
+	printf("requests         = %lu\n", stats.requests);
+	printf("bytes read       = %llu\n", stats.bytes);
+	printf("seek distance    = %llu\n", stats.seek);
+	printf("over-read bytes  = %llu\n", stats.over_read);
+	printf("re-read bytes    = %llu\n", stats.re_read);
+
+	if (dump_file)
+		dump_mem1(dump_file);
+
+	unmap_file(&mf);
+
+	return 0;
+}
@@ -21,86 +21,32 @@
 #include <fcntl.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include "../include/lib.h"
-
-#define BUF_SIZE 4096
-static char buf[BUF_SIZE];
-
-#define BNR_WIDTH 96
-#define BNR_HEIGHT 32
-
-unsigned int rgb32_image[BNR_WIDTH*BNR_HEIGHT];
+#include "../include/cubeboot.h"
 
 void bnr2ppm(void *image, off_t image_size)
 {
-	unsigned char *p, *outp;
-	unsigned short *rgba, rgba_cpu;
-	unsigned int r, g, b;
-
-#define BNR_TILE_SIZE (4*4) /* 4 x 4 16 bits = 32 bytes */
-
-	int width = BNR_WIDTH, height = BNR_HEIGHT;
-	int tiles = (width * height) / BNR_TILE_SIZE;
-
-	int tile, pixel_count;
-	int row, col;
-	int i, j, pos;
-
-	p = image;
-	if (memcmp(p, "BNR1", 4) && memcmp(p, "BNR2", 4))
+	unsigned char rgb[CB_BNR_RGB_SIZE];
+	struct writer w;
+	char header[32];
+	int len;
+	int error;
+
+	error = cb_bnr_decode(image, image_size, rgb, sizeof(rgb));
+	if (error == CB_EFORMAT)
 		die("not a banner file\n");
+	else if (error)
+		die("can't decode banner: %s\n", cb_strerror(error));
 
-	pixel_count = 0x1800 / sizeof(*rgba);
-	rgba = (unsigned short *)(image + 0x20);
-
-	printf("P6 %d %d %d\n", BNR_WIDTH, BNR_HEIGHT, 255);
-	if (pixel_count != BNR_WIDTH * BNR_HEIGHT)
-		die("wrong pixel count\n");
+	writer_init(&w, STDOUT_FILENO, WRITER_BUFFER_SIZE);
 
-	memset(rgb32_image, 0, sizeof(rgb32_image));
-
-	col = row = 0;
-	for (tile = 0; tile < tiles; tile++, rgba += BNR_TILE_SIZE) {
-		for(i=0; i<4; i++) { /* Y */
-			for(j=0; j<4; j++) { /* X */
-				rgba_cpu = be16_to_cpu(rgba[4*i+j]);
-
-				/* retrieve components */
-				r = (rgba_cpu >> 10) & 0x1f;
-				g = (rgba_cpu >> 5) & 0x1f;
-				b = (rgba_cpu >> 0) & 0x1f;
-
-				/* aproximate to 8 bits */
-				r = (r << 3) | (r >> 2);
-				g = (g << 3) | (g >> 2);
-				b = (b << 3) | (b >> 2);
-
-				pos = (row+i)*width + (col+j);
-				outp = (unsigned char *)&rgb32_image[pos];
-
-				*outp++ = r;
-				*outp++ = g;
-				*outp++ = b;
-			}
-		}
-
-		col += 4;
-		if (col >= BNR_WIDTH) {
-			col = 0;
-			row += 4;
-		}
-	}
-
-	outp = (unsigned char *)rgb32_image;
-	while(pixel_count-- > 0) {
-		r = *outp++;
-		g = *outp++;
-		b = *outp++;
-		outp++;
-		printf("%c%c%c", r, g, b);
-	}
-	printf("\n");
+	len = sprintf(header, "P6 %d %d %d\n", BNR_WIDTH, BNR_HEIGHT, 255);
+	if (writer_write(&w, header, len) < 0 ||
+	    writer_write(&w, rgb, sizeof(rgb)) < 0 ||
+	    writer_write(&w, "\n", 1) < 0 || writer_release(&w) < 0)
+		die("write failed: %s\n", strerror(errno));
 }
 
 /*
@@ -109,11 +55,12 @@ void bnr2ppm(void *image, off_t image_size)
 int main(int argc, char *argv[])
 {
 	int result;
-	void *image;
-	off_t image_size;
+	struct mapped_file mf;
+
+	map_file("opening.bnr", &mf);
 
-	image = slurp_file("opening.bnr", &image_size);
+	bnr2ppm(mf.data, mf.size);
 
-	bnr2ppm(image, image_size);
+	unmap_file(&mf);
 }
 
@@ -0,0 +1,396 @@
+/**
+ * cache.c
+ *
+ * Content addressed cache of build artifacts.
+ *
+ * Copyright (C) 2005-2006 The GameCube Linux Team
+ * Copyright (C) 2005,2006 Albert Herranz
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ */
+
+/*
+ * Tools hash everything that determines an output (tool version,
+ * options and input contents) and look the digest up in the cache
+ * directory named by $CUBEBOOT_CACHE.
+ * On a hit the cached artifact is hard linked as the output, on a miss
+ * the tool builds the output as usual and then links it into the cache.
+ *
+ * Entries live in DIR/xx/yyyy..., where xxyyyy... is the sha-256 of the
+ * key. Hit and miss counters for all the tools are kept in DIR/stats.
+ *
+ * Everything here may be used from several threads at once (mkgbi writes
+ * its batches from a pool of them), as long as each thread uses its own
+ * keys and output files. Entries are published with an atomic rename, the
+ * stats file is updated under flock, which also holds between threads as
+ * each opens the file on its own, and the counters of this process are
+ * kept under counters_lock.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../include/lib.h"
+#include "../include/cache.h"
+
+static unsigned long nr_hits, nr_misses;
+static unsigned long total_hits, total_misses;
+static pthread_mutex_t counters_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define ror32(x, n)	(((x) >> (n)) | ((x) << (32 - (n))))
+
+/*
+ *
+ */
+static void sha256_block(uint32_t *state, const unsigned char *p)
+{
+	uint32_t w[64], s[8], t1, t2;
+	int i;
+
+	for (i = 0; i < 16; i++, p += 4)
+		w[i] = (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+	for (; i < 64; i++) {
+		t1 = ror32(w[i - 2], 17) ^ ror32(w[i - 2], 19) ^
+		    (w[i - 2] >> 10);
+		t2 = ror32(w[i - 15], 7) ^ ror32(w[i - 15], 18) ^
+		    (w[i - 15] >> 3);
+		w[i] = w[i - 16] + t2 + w[i - 7] + t1;
+	}
+
+	memcpy(s, state, sizeof(s));
+	for (i = 0; i < 64; i++) {
+		t1 = s[7] + (ror32(s[4], 6) ^ ror32(s[4], 11) ^
+			     ror32(s[4], 25)) +
+		    ((s[4] & s[5]) ^ (~s[4] & s[6])) + sha256_k[i] + w[i];
+		t2 = (ror32(s[0], 2) ^ ror32(s[0], 13) ^ ror32(s[0], 22)) +
+		    ((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]));
+		memmove(s + 1, s, 7 * sizeof(*s));
+		s[4] += t1;
+		s[0] = t1 + t2;
+	}
+	for (i = 0; i < 8; i++)
+		state[i] += s[i];
+}
+
+/*
+ *
+ */
+static void sha256_update(struct cache_key *key, const void *data,
+			  size_t size)
+{
+	const unsigned char *p = data;
+	unsigned int used, chunk;
+
+	while (size > 0) {
+		used = key->length % sizeof(key->block);
+		chunk = sizeof(key->block) - used;
+		if (chunk > size)
+			chunk = size;
+		memcpy(key->block + used, p, chunk);
+		key->length += chunk;
+		p += chunk;
+		size -= chunk;
+		if (used + chunk == sizeof(key->block))
+			sha256_block(key->state, key->block);
+	}
+}
+
+/*
+ * Computes the name of the cache entry for a key.
+ */
+static void sha256_final(struct cache_key *key)
+{
+	static const char hex[] = "0123456789abcdef";
+	unsigned char trailer[8];
+	uint64_t bits = key->length * 8;
+	unsigned int i;
+
+	for (i = 0; i < 8; i++)
+		trailer[i] = bits >> (56 - 8 * i);
+	sha256_update(key, "\x80", 1);
+	while (key->length % sizeof(key->block) != sizeof(key->block) - 8)
+		sha256_update(key, "", 1);
+	sha256_update(key, trailer, sizeof(trailer));
+
+	for (i = 0; i < 32; i++) {
+		unsigned char byte = key->state[i / 4] >> (24 - 8 * (i % 4));
+		key->name[2 * i] = hex[byte >> 4];
+		key->name[2 * i + 1] = hex[byte & 0xf];
+	}
+	key->name[64] = '\0';
+}
+
+/*
+ *
+ */
+void cache_key_init(struct cache_key *key, const char *tool,
+		    const char *version)
+{
+	static const uint32_t sha256_h[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+	};
+
+	memset(key, 0, sizeof(*key));
+	memcpy(key->state, sha256_h, sizeof(key->state));
+	cache_key_add_string(key, tool);
+	cache_key_add_string(key, version);
+}
+
+/*
+ * Every item is prefixed by its size, so that different sequences of
+ * items never hash the same bytes.
+ */
+void cache_key_add(struct cache_key *key, const void *data, size_t size)
+{
+	unsigned char prefix[8];
+	uint64_t length = size;
+	unsigned int i;
+
+	for (i = 0; i < 8; i++)
+		prefix[i] = length >> (8 * i);
+	sha256_update(key, prefix, sizeof(prefix));
+	sha256_update(key, data, size);
+}
+
+/*
+ *
+ */
+void cache_key_add_string(struct cache_key *key, const char *s)
+{
+	cache_key_add(key, s, strlen(s));
+}
+
+/*
+ *
+ */
+void cache_key_add_file(struct cache_key *key, const char *filename)
+{
+	struct mapped_file mf;
+
+	map_file(filename, &mf);
+	cache_key_add(key, mf.data, mf.size);
+	unmap_file(&mf);
+}
+
+/*
+ *
+ */
+int cache_enabled(void)
+{
+	char *dir = getenv(CACHE_ENV);
+
+	return dir && *dir;
+}
+
+/*
+ *
+ */
+static char *cache_path(struct cache_key *key, int create)
+{
+	char *dir = getenv(CACHE_ENV);
+	char *path;
+
+	path = xmalloc(strlen(dir) + 1 + 2 + 1 + 62 + 1);
+	if (create)
+		mkdir(dir, 0777);
+	sprintf(path, "%s/%.2s", dir, key->name);
+	if (create)
+		mkdir(path, 0777);
+	strcat(path, "/");
+	strcat(path, key->name + 2);
+	return path;
+}
+
+/*
+ * Updates the hit and miss counters shared by all the tools.
+ */
+static void cache_count(int hit)
+{
+	char *dir = getenv(CACHE_ENV);
+	char *path, buf[64];
+	unsigned long hits = 0, misses = 0;
+	ssize_t len;
+	int fd;
+
+	mkdir(dir, 0777);
+	path = xmalloc(strlen(dir) + sizeof("/stats"));
+	sprintf(path, "%s/stats", dir);
+	fd = open(path, O_RDWR | O_CREAT, 0666);
+	free(path);
+	if (fd < 0)
+		return;
+
+	if (flock(fd, LOCK_EX) == 0) {
+		len = pread(fd, buf, sizeof(buf) - 1, 0);
+		if (len > 0) {
+			buf[len] = '\0';
+			sscanf(buf, "hits %lu misses %lu", &hits, &misses);
+		}
+		if (hit)
+			hits++;
+		else
+			misses++;
+		len = sprintf(buf, "hits %lu\nmisses %lu\n", hits, misses);
+		if (pwrite(fd, buf, len, 0) == len)
+			ftruncate(fd, len);
+	}
+
+	pthread_mutex_lock(&counters_lock);
+	if (hit)
+		nr_hits++;
+	else
+		nr_misses++;
+	/* threads may finish in any order, keep the latest totals */
+	if (hits + misses > total_hits + total_misses) {
+		total_hits = hits;
+		total_misses = misses;
+	}
+	pthread_mutex_unlock(&counters_lock);
+	close(fd);
+}
+
+/*
+ *
+ */
+static int copy_file(const char *from, const char *to)
+{
+	char buf[16384];
+	ssize_t len;
+	int in, out, result = 0;
+
+	in = open(from, O_RDONLY);
+	if (in < 0)
+		return -1;
+	out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (out < 0) {
+		close(in);
+		return -1;
+	}
+	while ((len = read(in, buf, sizeof(buf))) > 0) {
+		if (write_full(out, buf, len) < 0)
+			break;
+	}
+	if (len != 0)
+		result = -1;
+	close(in);
+	if (close(out) < 0)
+		result = -1;
+	return result;
+}
+
+/*
+ * Looks up a key, linking the cached artifact as outfile on a hit.
+ * On a miss outfile is removed, so that writing it doesn't clobber a
+ * cached artifact it may still be linked to.
+ * Returns 1 on hit.
+ */
+int cache_fetch(struct cache_key *key, const char *outfile)
+{
+	char *path;
+	int hit = 0;
+
+	if (!cache_enabled())
+		return 0;
+
+	sha256_final(key);
+	path = cache_path(key, 0);
+
+	if (unlink(outfile) < 0 && errno != ENOENT)
+		die("%s: can't remove: %s\n", outfile, strerror(errno));
+	if (access(path, F_OK) == 0) {
+		if (link(path, outfile) == 0 || copy_file(path, outfile) == 0)
+			hit = 1;
+		else
+			unlink(outfile);
+	}
+	free(path);
+
+	/* the artifact is as new as the inputs, as far as make knows */
+	if (hit)
+		utimensat(AT_FDCWD, outfile, NULL, 0);
+
+	cache_count(hit);
+	return hit;
+}
+
+/*
+ * Adds a freshly built outfile to the cache, after a miss.
+ * Failing to do so is not fatal.
+ */
+void cache_store(struct cache_key *key, const char *outfile)
+{
+	static unsigned long seq;
+	char *path, *tmp;
+
+	if (!cache_enabled())
+		return;
+
+	path = cache_path(key, 1);
+	tmp = xmalloc(strlen(path) + 64);
+	sprintf(tmp, "%.*s.tmp-%ld-%lu", (int)(strlen(path) - 62), path,
+		(long)getpid(), __sync_fetch_and_add(&seq, 1));
+
+	if ((link(outfile, tmp) < 0 && copy_file(outfile, tmp) < 0) ||
+	    rename(tmp, path) < 0) {
+		fprintf(stderr, "%s: can't add to cache: %s\n", outfile,
+			strerror(errno));
+		unlink(tmp);
+	}
+	free(tmp);
+	free(path);
+}
+
+/*
+ *
+ */
+void cache_report(FILE *f)
+{
+	unsigned long hits, misses, all_hits, all_misses;
+
+	if (!cache_enabled())
+		return;
+
+	pthread_mutex_lock(&counters_lock);
+	hits = nr_hits;
+	misses = nr_misses;
+	all_hits = total_hits;
+	all_misses = total_misses;
+	pthread_mutex_unlock(&counters_lock);
+
+	if (hits + misses == 0)
+		return;
+	fprintf(f, "cache: %lu hits, %lu misses"
+		" (%lu hits, %lu misses overall)\n",
+		hits, misses, all_hits, all_misses);
+}
@@ -19,6 +19,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -68,68 +69,257 @@ void *xrealloc(void *ptr, size_t size)
 }
 
 /*
- *
+ * Writes all of a buffer, carrying on after short writes.
  */
-int pad_file(int fd, int size)
+ssize_t write_full(int fd, const void *buf, size_t count)
 {
-	static char filler[32];
-	int len, chunk;
-	int result;
+	size_t progress = 0;
+	ssize_t result;
 
-	for (len = size; len > 0; len -= chunk) {
-		chunk = (len > 32) ? 32 : len;
-		result = write(fd, filler, chunk);
-		if (result < 0)
+	while (progress < count) {
+		result = write(fd, buf + progress, count - progress);
+		if (result < 0) {
+			if ((errno == EINTR) || (errno == EAGAIN))
+				continue;
 			return result;
+		}
+		if (result == 0) {
+			errno = ENOSPC;
+			return -1;
+		}
+		progress += result;
 	}
-	return 0;
+	return progress;
+}
 
+/*
+ * Buffered output.
+ * Writes are gathered in a buffer of the given size and issued in as few
+ * system calls as possible. Writes as large as the buffer go straight
+ * to the file.
+ * All functions return a negative value and leave errno set on error.
+ */
+void writer_init(struct writer *w, int fd, size_t size)
+{
+	w->fd = fd;
+	w->buf = xmalloc(size);
+	w->size = size;
+	w->used = 0;
+	w->offset = 0;
 }
 
 /*
  *
  */
-char *slurp_file(const char *filename, off_t * r_size)
+int writer_flush(struct writer *w)
 {
-	int fd;
-	char *buf;
-	off_t aligned_size, size, progress;
-	ssize_t result;
-	struct stat stats;
+	size_t used = w->used;
 
-	if (!filename) {
-		*r_size = 0;
-		return 0;
-	}
-	fd = open(filename, O_RDONLY);
-	if (fd < 0) {
-		die("Cannot open `%s': %s\n", filename, strerror(errno));
+	w->used = 0;
+	if (used && write_full(w->fd, w->buf, used) < 0)
+		return -1;
+	return 0;
+}
+
+/*
+ *
+ */
+int writer_write(struct writer *w, const void *data, size_t count)
+{
+	if (w->used + count > w->size && writer_flush(w) < 0)
+		return -1;
+
+	w->offset += count;
+	if (count >= w->size)
+		return (write_full(w->fd, data, count) < 0) ? -1 : 0;
+
+	memcpy(w->buf + w->used, data, count);
+	w->used += count;
+	return 0;
+}
+
+/*
+ * Writes count bytes with value c.
+ */
+int writer_pad(struct writer *w, size_t count, int c)
+{
+	size_t chunk;
+
+	while (count > 0) {
+		if (w->used == w->size && writer_flush(w) < 0)
+			return -1;
+		chunk = w->size - w->used;
+		if (chunk > count)
+			chunk = count;
+		memset(w->buf + w->used, c, chunk);
+		w->used += chunk;
+		w->offset += chunk;
+		count -= chunk;
 	}
-	result = fstat(fd, &stats);
-	if (result < 0) {
-		die("Cannot stat: %s: %s\n", filename, strerror(errno));
+	return 0;
+}
+
+/*
+ * Pads with c up to the given output offset.
+ */
+int writer_pad_to(struct writer *w, off_t offset, int c)
+{
+	if (offset < w->offset) {
+		errno = EINVAL;
+		return -1;
 	}
-	size = stats.st_size;
-	//aligned_size = di_align_size(size);
-	aligned_size = size;
-	*r_size = aligned_size;
-	buf = xmalloc(aligned_size);
-	memset(buf, 0, aligned_size);
+	return writer_pad(w, offset - w->offset, c);
+}
+
+/*
+ * Pads with c up to the next multiple of alignment.
+ */
+int writer_align_to(struct writer *w, size_t alignment, int c)
+{
+	off_t rem = w->offset % alignment;
+
+	return rem ? writer_pad(w, alignment - rem, c) : 0;
+}
+
+/*
+ * Flushes the remaining output and frees the buffer.
+ */
+int writer_release(struct writer *w)
+{
+	int result;
+
+	result = writer_flush(w);
+	free(w->buf);
+	w->buf = NULL;
+	return result;
+}
+
+/*
+ * Reads everything left in a file, whose size may not be known in
+ * advance (pipes).
+ * Returns 0, or the errno value of the failed read.
+ */
+static int read_all(int fd, off_t size_hint, struct mapped_file *mf)
+{
+	char *buf;
+	off_t size, progress;
+	ssize_t result;
+
+	size = (size_hint > 0) ? size_hint : 16384;
+	buf = xmalloc(size);
 	progress = 0;
-	while (progress < size) {
+	for (;;) {
+		if (progress == size) {
+			if (size_hint > 0)
+				break;	/* a regular file, all of it read */
+			size *= 2;
+			buf = xrealloc(buf, size);
+		}
 		result = read(fd, buf + progress, size - progress);
 		if (result < 0) {
 			if ((errno == EINTR) || (errno == EAGAIN))
 				continue;
-			die("read on %s of %ld bytes failed: %s\n",
-			    filename, (size - progress) + 0UL, strerror(errno));
+			result = errno;
+			free(buf);
+			return result;
 		}
+		if (result == 0)
+			break;
 		progress += result;
 	}
-	result = close(fd);
-	if (result < 0) {
-		die("Close of %s failed: %s\n", filename, strerror(errno));
+	mf->data = buf;
+	mf->size = progress;
+	return 0;
+}
+
+/*
+ * Maps the rest of an open file in memory, straight from the page cache.
+ * The mapping is private, so changes made by the caller never reach the
+ * file. Files that can't be mapped (pipes, for example) are read instead.
+ * Returns 0, or an errno value. For the long running programs, which
+ * can't just die on a bad input.
+ */
+int try_map_fd(int fd, struct mapped_file *mf)
+{
+	struct stat stats;
+	off_t pos;
+
+	memset(mf, 0, sizeof(*mf));
+
+	if (fstat(fd, &stats) < 0)
+		return errno;
+
+	pos = lseek(fd, 0, SEEK_CUR);
+	if (S_ISREG(stats.st_mode) && pos == 0 && stats.st_size > 0) {
+		mf->data = mmap(NULL, stats.st_size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE, fd, 0);
+		if (mf->data != MAP_FAILED) {
+			mf->size = stats.st_size;
+			mf->mapped = 1;
+			return 0;
+		}
+		mf->data = NULL;
 	}
-	return buf;
+	return read_all(fd, (S_ISREG(stats.st_mode) && pos >= 0) ?
+			stats.st_size - pos : 0, mf);
 }
 
+/*
+ * Like try_map_fd(), but always copies the file in memory, so changes to
+ * the file later, even truncating it, don't show up in the copy.
+ */
+int try_read_fd(int fd, struct mapped_file *mf)
+{
+	struct stat stats;
+	off_t pos;
+
+	memset(mf, 0, sizeof(*mf));
+
+	if (fstat(fd, &stats) < 0)
+		return errno;
+
+	pos = lseek(fd, 0, SEEK_CUR);
+	return read_all(fd, (S_ISREG(stats.st_mode) && pos >= 0) ?
+			stats.st_size - pos : 0, mf);
+}
+
+/*
+ * Ditto (try_map_fd), dying if the file can't be read.
+ */
+void map_fd(int fd, const char *filename, struct mapped_file *mf)
+{
+	int error;
+
+	error = try_map_fd(fd, mf);
+	if (error)
+		die("Cannot read %s: %s\n", filename, strerror(error));
+}
+
+/*
+ * Maps a whole file in memory.
+ */
+void map_file(const char *filename, struct mapped_file *mf)
+{
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		die("Cannot open `%s': %s\n", filename, strerror(errno));
+
+	map_fd(fd, filename, mf);
+
+	if (close(fd) < 0)
+		die("Close of %s failed: %s\n", filename, strerror(errno));
+}
+
+/*
+ *
+ */
+void unmap_file(struct mapped_file *mf)
+{
+	if (mf->mapped)
+		munmap(mf->data, mf->size);
+	else
+		free(mf->data);
+	memset(mf, 0, sizeof(*mf));
+}
@@ -0,0 +1,828 @@
+/*
+ * cubebootd.c
+ *
+ * Builds boot images and relocated DOLs on request, over a Unix socket.
+ * This program is part of the cubeboot-tools package.
+ *
+ * Copyright (C) 2005-2006 The GameCube Linux Team
+ * Copyright (C) 2005,2006 Albert Herranz
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ */
+
+/*
+ * Clients talk to the daemon over a stream connection, sending as many
+ * requests as they like. A request is a command line, followed by
+ * "key = value" lines and an empty line:
+ *
+ *   relocate		in, [out], [releng], [stop_motor], [disable_xenogc],
+ *			[compress], [placement] (low or high), [zero_run]
+ *   gbi		[out], [apploader], [banner] and the mkgbi manifest keys
+ *
+ * Each request gets a single line back, "ok SIZE" or "error MESSAGE".
+ * Without an out key, the result is not written anywhere: the "ok" line
+ * carries a file descriptor with it (SCM_RIGHTS), open on a memory file.
+ *
+ * The apploaders, relocation engines and banners used are kept in memory
+ * until they change on disk. Connections are served by a pool of worker
+ * threads, each with its own model of the GameCube memory to check the
+ * relocated DOLs in.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "../include/lib.h"
+#include "../include/dolrel.h"
+#include "../include/cubeboot.h"
+
+#include <getopt.h>
+
+#define CUBEBOOTD_VERSION "V0.1-20061017"
+
+#define DEFAULT_SOCKET		"cubebootd.sock"
+#define DEFAULT_APPLOADER_BIN	"apploader.bin"
+#define DEFAULT_OPENING_BNR	GCM_OPENING_BNR
+#define DEFAULT_SDRE_BIN	"sdre.bin"
+
+#define MAX_REQUEST_FIELDS	32
+#define MAX_LINE		1024
+#define QUEUE_SIZE		64
+
+const char *__progname;
+
+char *apploader_bin = DEFAULT_APPLOADER_BIN;
+char *opening_bnr = DEFAULT_OPENING_BNR;
+char *sdre_bin = DEFAULT_SDRE_BIN;
+
+/*
+ * A file kept in memory between requests.
+ * The list holds a reference to the current version of each file, and
+ * each request using it another one.
+ */
+struct resident {
+	char *filename;
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	struct timespec mtime;
+	struct mapped_file mf;
+	unsigned int refs;
+	struct resident *next;
+};
+
+static struct resident *residents;
+static pthread_mutex_t residents_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Accepted connections, waiting for a worker.
+ */
+static struct {
+	int fds[QUEUE_SIZE];
+	unsigned int head, count;
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty, not_full;
+} queue = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.not_empty = PTHREAD_COND_INITIALIZER,
+	.not_full = PTHREAD_COND_INITIALIZER,
+};
+
+struct request {
+	char command[MAX_LINE];
+	unsigned int nr_fields;
+	char *keys[MAX_REQUEST_FIELDS];
+	char *values[MAX_REQUEST_FIELDS];
+	char error[MAX_LINE];
+};
+
+static volatile sig_atomic_t quit;
+
+/*
+ * Reads a regular file, failing instead of dying when it can't be read.
+ * The file is copied, not mapped: a mapping would raise SIGBUS in the
+ * whole daemon if the file got truncated while in use. Nothing bigger
+ * than MEM1 is worth reading.
+ */
+static int load_file(const char *filename, struct mapped_file *mf,
+		     struct stat *stats)
+{
+	int fd, error;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return errno;
+	if (fstat(fd, stats) < 0) {
+		error = errno;
+		close(fd);
+		return error;
+	}
+	if (!S_ISREG(stats->st_mode)) {
+		close(fd);
+		return EINVAL;
+	}
+	if (stats->st_size > CB_MEM1_SIZE) {
+		close(fd);
+		return EFBIG;
+	}
+	error = try_read_fd(fd, mf);
+	close(fd);
+	return error;
+}
+
+/*
+ *
+ */
+static void put_resident(struct resident *res)
+{
+	pthread_mutex_lock(&residents_lock);
+	if (--res->refs == 0) {
+		unmap_file(&res->mf);
+		free(res->filename);
+		free(res);
+	}
+	pthread_mutex_unlock(&residents_lock);
+}
+
+/*
+ * Returns the in-memory copy of a file, loading it if it is not there
+ * or it changed since it was loaded.
+ */
+static int get_resident(const char *filename, struct resident **resp)
+{
+	struct resident *res, **pp;
+	struct stat stats;
+	int error;
+
+	if (stat(filename, &stats) < 0)
+		return errno;
+
+	pthread_mutex_lock(&residents_lock);
+	for (res = residents; res; res = res->next) {
+		if (!strcmp(res->filename, filename) &&
+		    res->dev == stats.st_dev && res->ino == stats.st_ino &&
+		    res->size == stats.st_size &&
+		    res->mtime.tv_sec == stats.st_mtim.tv_sec &&
+		    res->mtime.tv_nsec == stats.st_mtim.tv_nsec) {
+			res->refs++;
+			pthread_mutex_unlock(&residents_lock);
+			*resp = res;
+			return 0;
+		}
+	}
+	pthread_mutex_unlock(&residents_lock);
+
+	res = xmalloc(sizeof(*res));
+	error = load_file(filename, &res->mf, &stats);
+	if (error) {
+		free(res);
+		return error;
+	}
+	res->filename = strdup(filename);
+	res->dev = stats.st_dev;
+	res->ino = stats.st_ino;
+	res->size = stats.st_size;
+	res->mtime = stats.st_mtim;
+	res->refs = 2;
+
+	/* replace the previous version, if any */
+	pthread_mutex_lock(&residents_lock);
+	for (pp = &residents; *pp; pp = &(*pp)->next) {
+		if (!strcmp((*pp)->filename, filename)) {
+			struct resident *old = *pp;
+
+			*pp = old->next;
+			if (--old->refs == 0) {
+				unmap_file(&old->mf);
+				free(old->filename);
+				free(old);
+			}
+			break;
+		}
+	}
+	res->next = residents;
+	residents = res;
+	pthread_mutex_unlock(&residents_lock);
+
+	*resp = res;
+	return 0;
+}
+
+/*
+ *
+ */
+static const char *request_get(struct request *req, const char *key)
+{
+	unsigned int i;
+
+	for (i = 0; i < req->nr_fields; i++) {
+		if (!strcmp(req->keys[i], key))
+			return req->values[i];
+	}
+	return NULL;
+}
+
+/*
+ *
+ */
+static int request_flag(struct request *req, const char *key)
+{
+	const char *value = request_get(req, key);
+
+	return value && strcmp(value, "0") && strcmp(value, "no");
+}
+
+/*
+ *
+ */
+static char *strip(char *s)
+{
+	char *end;
+
+	while (*s == ' ' || *s == '\t')
+		s++;
+	end = s + strlen(s);
+	while (end > s && (end[-1] == ' ' || end[-1] == '\t' ||
+			   end[-1] == '\n' || end[-1] == '\r'))
+		end--;
+	*end = '\0';
+	return s;
+}
+
+/*
+ *
+ */
+static void free_request(struct request *req)
+{
+	unsigned int i;
+
+	for (i = 0; i < req->nr_fields; i++)
+		free(req->keys[i]);
+	req->nr_fields = 0;
+}
+
+/*
+ * Reads the next request. Returns 0 at the end of the connection.
+ * A malformed request is still returned, with its error set.
+ */
+static int read_request(FILE *f, struct request *req)
+{
+	char line[MAX_LINE], *s, *key, *value;
+
+	memset(req, 0, sizeof(*req));
+
+	/* skip empty lines between requests */
+	do {
+		if (!fgets(line, sizeof(line), f))
+			return 0;
+		s = strip(line);
+	} while (!*s);
+	strcpy(req->command, s);
+
+	while (fgets(line, sizeof(line), f)) {
+		s = strip(line);
+		if (!*s)
+			return 1;
+		if (req->error[0])
+			continue;
+
+		value = strchr(s, '=');
+		if (!value) {
+			snprintf(req->error, sizeof(req->error),
+				 "expected `key = value', got `%s'", s);
+			continue;
+		}
+		if (req->nr_fields == MAX_REQUEST_FIELDS) {
+			strcpy(req->error, "too many fields");
+			continue;
+		}
+		*value++ = '\0';
+		s = strip(s);
+		value = strip(value);
+
+		/* key and value share a single allocation */
+		key = xmalloc(strlen(s) + strlen(value) + 2);
+		strcpy(key, s);
+		req->keys[req->nr_fields] = key;
+		req->values[req->nr_fields] = strcpy(key + strlen(key) + 1,
+						     value);
+		req->nr_fields++;
+	}
+	/* a request cut short is served anyway */
+	return 1;
+}
+
+/*
+ * Writes a result where the request asked for, or into a memory file
+ * whose descriptor is returned in out_fd.
+ */
+static int put_result(struct request *req, const void *buf, size_t size,
+		      int *out_fd)
+{
+	const char *outfile = request_get(req, "out");
+	int fd, error;
+
+	*out_fd = -1;
+	if (outfile)
+		fd = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	else
+		fd = memfd_create(req->command, MFD_CLOEXEC);
+	if (fd < 0)
+		goto failed;
+
+	if (write_full(fd, buf, size) < 0)
+		goto failed_close;
+	if (outfile) {
+		if (close(fd) < 0)
+			goto failed;
+	} else {
+		if (lseek(fd, 0, SEEK_SET) < 0)
+			goto failed_close;
+		*out_fd = fd;
+	}
+	return 0;
+
+failed_close:
+	error = errno;
+	close(fd);
+	errno = error;
+failed:
+	snprintf(req->error, sizeof(req->error), "%s: %s",
+		 outfile ? outfile : "*memfd*", strerror(errno));
+	return -1;
+}
+
+/*
+ * mem1 is the worker's CB_MEM1_SIZE bytes model of the GameCube memory,
+ * where the result is checked.
+ */
+static void *build_relocated_dol(struct request *req, size_t *size,
+				 void *mem1)
+{
+	const char *infile = request_get(req, "in");
+	const char *releng = request_get(req, "releng");
+	const char *placement = request_get(req, "placement");
+	const char *zero_run = request_get(req, "zero_run");
+	char *end;
+	struct resident *sdre;
+	struct mapped_file dol;
+	struct stat stats;
+	struct cb_dolrel_options options;
+	void *buf = NULL;
+	int error;
+
+	if (!infile) {
+		strcpy(req->error, "no input dol (in)");
+		return NULL;
+	}
+	memset(&options, 0, sizeof(options));
+	if (request_flag(req, "stop_motor"))
+		options.flags |= DOLREL_FLAG_STOP_MOTOR;
+	if (request_flag(req, "disable_xenogc"))
+		options.flags |= DOLREL_FLAG_DISABLE_XENOGC;
+	options.compress = request_flag(req, "compress");
+	if (placement && !strcmp(placement, "high")) {
+		options.placement = CB_PLACE_HIGH;
+	} else if (placement && strcmp(placement, "low")) {
+		strcpy(req->error, "placement is low or high");
+		return NULL;
+	}
+	options.zero_run = CB_DOLREL_ZERO_RUN;
+	if (zero_run) {
+		options.zero_run = strtoul(zero_run, &end, 0);
+		if (!*zero_run || *end) {
+			strcpy(req->error, "bad zero_run");
+			return NULL;
+		}
+	}
+
+	if (!releng)
+		releng = sdre_bin;
+	error = get_resident(releng, &sdre);
+	if (error) {
+		snprintf(req->error, sizeof(req->error), "%s: %s", releng,
+			 strerror(error));
+		return NULL;
+	}
+	error = load_file(infile, &dol, &stats);
+	if (error) {
+		snprintf(req->error, sizeof(req->error), "%s: %s", infile,
+			 strerror(error));
+		goto out_put;
+	}
+
+	error = cb_dolrel(dol.data, dol.size, sdre->mf.data, sdre->mf.size,
+			  &options, NULL, 0, size);
+	if (error == CB_ENOSPC) {
+		buf = xmalloc(*size);
+		error = cb_dolrel(dol.data, dol.size, sdre->mf.data,
+				  sdre->mf.size, &options, buf, *size, size);
+	}
+	if (error) {
+		snprintf(req->error, sizeof(req->error),
+			 "%s: can't relocate: %s", infile, cb_strerror(error));
+		free(buf);
+		buf = NULL;
+		goto out_unmap;
+	}
+
+	/* make sure the engine will get the original sections back */
+	error = cb_dolrel_check(buf, *size, sdre->mf.size, dol.data, dol.size,
+				mem1, CB_MEM1_SIZE);
+	if (error) {
+		snprintf(req->error, sizeof(req->error),
+			 "%s: relocated dol doesn't unpack: %s", infile,
+			 cb_strerror(error));
+		free(buf);
+		buf = NULL;
+	}
+
+out_unmap:
+	unmap_file(&dol);
+out_put:
+	put_resident(sdre);
+	return buf;
+}
+
+/*
+ *
+ */
+static void *build_gbi(struct request *req, size_t *size)
+{
+	struct gcm_system_area sa;
+	struct resident *apploader = NULL, *banner = NULL;
+	const char *al_name = apploader_bin, *bnr_name = opening_bnr;
+	char *fst = NULL, *buf = NULL;
+	size_t fst_size;
+	unsigned int i;
+	int error;
+
+	cb_gbi_defaults(&sa);
+	for (i = 0; i < req->nr_fields; i++) {
+		if (!strcmp(req->keys[i], "out"))
+			continue;
+		else if (!strcmp(req->keys[i], "apploader"))
+			al_name = req->values[i];
+		else if (!strcmp(req->keys[i], "banner"))
+			bnr_name = req->values[i];
+		else if (cb_gbi_set(&sa, req->keys[i], req->values[i])) {
+			snprintf(req->error, sizeof(req->error),
+				 "bad field `%s = %s'", req->keys[i],
+				 req->values[i]);
+			return NULL;
+		}
+	}
+
+	error = get_resident(al_name, &apploader);
+	if (error) {
+		snprintf(req->error, sizeof(req->error), "%s: %s", al_name,
+			 strerror(error));
+		goto out;
+	}
+	error = get_resident(bnr_name, &banner);
+	if (error) {
+		snprintf(req->error, sizeof(req->error), "%s: %s", bnr_name,
+			 strerror(error));
+		goto out;
+	}
+	sa.al_image = apploader->mf.data;
+	sa.al_size = apploader->mf.size;
+	sa.bnr_image = banner->mf.data;
+	sa.bnr_size = banner->mf.size;
+
+	cb_fst_single_file(GCM_OPENING_BNR, sa.bnr_size, NULL, 0, &fst_size);
+	fst = xmalloc(fst_size);
+	cb_fst_single_file(GCM_OPENING_BNR, sa.bnr_size, fst, fst_size,
+			   &fst_size);
+	sa.fst_image = fst;
+	sa.fst_size = fst_size;
+
+	*size = SYSTEM_AREA_SIZE;
+	buf = xmalloc(*size);
+	error = cb_gbi_build(&sa, buf, *size);
+	if (error) {
+		snprintf(req->error, sizeof(req->error),
+			 "can't build system area: %s", cb_strerror(error));
+		free(buf);
+		buf = NULL;
+	}
+
+out:
+	free(fst);
+	if (banner)
+		put_resident(banner);
+	if (apploader)
+		put_resident(apploader);
+	return buf;
+}
+
+/*
+ * Sends the answer to a request, and the result descriptor with it.
+ */
+static int reply(int conn, struct request *req, size_t size, int fd)
+{
+	char line[MAX_LINE + 16];
+	char control[CMSG_SPACE(sizeof(int))];
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	struct iovec iov;
+	ssize_t result;
+
+	if (req->error[0])
+		snprintf(line, sizeof(line), "error %s\n", req->error);
+	else
+		snprintf(line, sizeof(line), "ok %zu\n", size);
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = line;
+	iov.iov_len = strlen(line);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	if (fd >= 0) {
+		memset(control, 0, sizeof(control));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+	}
+
+	do {
+		result = sendmsg(conn, &msg, 0);
+	} while (result < 0 && errno == EINTR);
+	return (result < 0) ? -1 : 0;
+}
+
+/*
+ *
+ */
+static void serve_connection(int conn, void *mem1)
+{
+	struct request req;
+	FILE *f;
+	void *buf;
+	size_t size = 0;
+	int fd, result;
+
+	f = fdopen(dup(conn), "r");
+	if (!f) {
+		close(conn);
+		return;
+	}
+
+	while (read_request(f, &req)) {
+		buf = NULL;
+		fd = -1;
+		if (!req.error[0]) {
+			if (!strcmp(req.command, "relocate"))
+				buf = build_relocated_dol(&req, &size, mem1);
+			else if (!strcmp(req.command, "gbi"))
+				buf = build_gbi(&req, &size);
+			else
+				snprintf(req.error, sizeof(req.error),
+					 "unknown command `%s'", req.command);
+		}
+
+		if (buf) {
+			put_result(&req, buf, size, &fd);
+			free(buf);
+		}
+		result = reply(conn, &req, size, fd);
+		if (fd >= 0)
+			close(fd);
+		free_request(&req);
+		if (result < 0)
+			break;
+	}
+
+	fclose(f);
+	close(conn);
+}
+
+/*
+ * arg is the worker's own scratch model of MEM1, see build_relocated_dol.
+ */
+static void *worker(void *arg)
+{
+	void *mem1 = arg;
+	int conn;
+
+	for (;;) {
+		pthread_mutex_lock(&queue.lock);
+		while (!queue.count)
+			pthread_cond_wait(&queue.not_empty, &queue.lock);
+		conn = queue.fds[queue.head];
+		queue.head = (queue.head + 1) % QUEUE_SIZE;
+		queue.count--;
+		pthread_cond_signal(&queue.not_full);
+		pthread_mutex_unlock(&queue.lock);
+
+		serve_connection(conn, mem1);
+	}
+	return NULL;
+}
+
+/*
+ *
+ */
+static void enqueue_connection(int conn)
+{
+	pthread_mutex_lock(&queue.lock);
+	while (queue.count == QUEUE_SIZE)
+		pthread_cond_wait(&queue.not_full, &queue.lock);
+	queue.fds[(queue.head + queue.count) % QUEUE_SIZE] = conn;
+	queue.count++;
+	pthread_cond_signal(&queue.not_empty);
+	pthread_mutex_unlock(&queue.lock);
+}
+
+/*
+ * Loads the default inputs in advance, so the first requests don't have
+ * to wait for them.
+ */
+static void preload(const char *filename)
+{
+	struct resident *res;
+	int error;
+
+	error = get_resident(filename, &res);
+	if (error) {
+		fprintf(stderr, "%s: %s: %s, requests must name another one\n",
+			__progname, filename, strerror(error));
+		return;
+	}
+	put_resident(res);
+}
+
+/*
+ *
+ */
+static void handle_quit(int sig)
+{
+	quit = 1;
+}
+
+/**
+ *
+ */
+void version(void)
+{
+	printf("version %s\n", CUBEBOOTD_VERSION);
+	exit(2);
+}
+
+/**
+ *
+ */
+void usage(void)
+{
+	fprintf(stderr,
+		"Usage: %s [OPTION]" "\n"
+		"  -S, --socket=PATH       listen on PATH"
+		" (default `" DEFAULT_SOCKET "')" "\n"
+		"  -a, --apploader=FILE    default apploader"
+		" (default `" DEFAULT_APPLOADER_BIN "')" "\n"
+		"  -b, --banner=FILE       default banner"
+		" (default `" DEFAULT_OPENING_BNR "')" "\n"
+		"  -r, --releng=PATH       default relocation engine image"
+		" (default `" DEFAULT_SDRE_BIN "')" "\n"
+		"  -j, --jobs=N            serve N connections at once"
+		" (default one per cpu)" "\n",
+		__progname);
+	exit(1);
+}
+
+/**
+ *
+ */
+int main(int argc, char *argv[])
+{
+	char *socket_path = DEFAULT_SOCKET;
+	struct sockaddr_un addr;
+	struct sigaction sa;
+	pthread_t thread;
+	int nr_jobs = 0;
+	int sock, conn, error, i;
+	char *p;
+	int ch;
+
+	struct option long_options[] = {
+		{"socket", 1, NULL, 'S'},
+		{"apploader", 1, NULL, 'a'},
+		{"banner", 1, NULL, 'b'},
+		{"releng", 1, NULL, 'r'},
+		{"jobs", 1, NULL, 'j'},
+		{"version", 0, NULL, 'v'},
+		{"help", 0, NULL, 'h'},
+		{0, 0, 0, 0}
+	};
+#define SHORT_OPTIONS "S:a:b:r:j:vh"
+
+	p = strrchr(argv[0], '/');
+	__progname = (p && p[1]) ? p + 1 : argv[0];
+
+	while ((ch = getopt_long(argc, argv, SHORT_OPTIONS,
+				 long_options, NULL)) != -1) {
+		switch (ch) {
+		case 'S':
+			socket_path = optarg;
+			break;
+		case 'a':
+			apploader_bin = optarg;
+			break;
+		case 'b':
+			opening_bnr = optarg;
+			break;
+		case 'r':
+			sdre_bin = optarg;
+			break;
+		case 'j':
+			nr_jobs = strtol(optarg, &p, 0);
+			if (*p || nr_jobs < 1)
+				usage();
+			break;
+		case 'v':
+			version();
+			break;
+		case 'h':
+		case '?':
+		default:
+			usage();
+			break;
+		}
+	}
+
+	if (argc - optind > 0)
+		usage();
+
+	if (!nr_jobs)
+		nr_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(socket_path) >= sizeof(addr.sun_path))
+		die("%s: socket path too long\n", socket_path);
+	strcpy(addr.sun_path, socket_path);
+
+	sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sock < 0)
+		die("can't create socket: %s\n", strerror(errno));
+	/* a previous daemon may have left its socket behind */
+	unlink(socket_path);
+	if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+		die("%s: can't bind: %s\n", socket_path, strerror(errno));
+	if (listen(sock, SOMAXCONN) < 0)
+		die("%s: can't listen: %s\n", socket_path, strerror(errno));
+
+	preload(apploader_bin);
+	preload(opening_bnr);
+	preload(sdre_bin);
+
+	/* clients going away must not take us with them */
+	signal(SIGPIPE, SIG_IGN);
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = handle_quit;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	for (i = 0; i < nr_jobs; i++) {
+		error = pthread_create(&thread, NULL, worker,
+				       xmalloc(CB_MEM1_SIZE));
+		if (error)
+			die("can't create thread: %s\n", strerror(error));
+		pthread_detach(thread);
+	}
+
+	while (!quit) {
+		conn = accept4(sock, NULL, NULL, SOCK_CLOEXEC);
+		if (conn < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			die("%s: can't accept: %s\n", socket_path,
+			    strerror(errno));
+		}
+		enqueue_connection(conn);
+	}
+
+	unlink(socket_path);
+	close(sock);
+	return 0;
+}
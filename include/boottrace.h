@@ -0,0 +1,71 @@
+/*
+ * boottrace.h
+ *
+ * Boot trace ring definitions.
+ * Copyright (C) 2005-2006 The GameCube Linux Team
+ * Copyright (C) 2005,2006 Albert Herranz
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ */
+
+#ifndef __BOOTTRACE_H
+#define __BOOTTRACE_H
+
+#include <stdint.h>
+
+/*
+ * The ring lives in lowmem, in the area left free by the OS between the
+ * exception vectors and the OS globals. All fields are big endian.
+ */
+#define BOOT_TRACE_ADDRESS	0x80001800
+#define BOOT_TRACE_MAGIC	0x42545243	/* "BTRC" */
+
+#define BOOT_TRACE_RECORDS	128		/* must be a power of 2 */
+
+/* the timebase runs at a quarter of the 162MHz bus clock */
+#define BOOT_TRACE_TICKS_PER_SEC	(162000000 / 4)
+
+/* event word: event id in the upper half, argument in the lower half */
+#define BOOT_TRACE_EVENT(id, arg)	(((id) << 16) | ((arg) & 0xffff))
+#define boot_trace_event_id(event)	((event) >> 16)
+#define boot_trace_event_arg(event)	((event) & 0xffff)
+
+enum boot_trace_event {
+	BOOT_TRACE_NONE = 0,
+
+	/* apploader */
+	BOOT_TRACE_AL_START,
+	BOOT_TRACE_AL_PATCH_IPL,
+	BOOT_TRACE_AL_PATCH_IPL_DONE,
+	BOOT_TRACE_AL_ENTER,
+	BOOT_TRACE_AL_LOAD,		/* argument is the step */
+	BOOT_TRACE_AL_EXIT,
+
+	/* silly dol relocation engine */
+	BOOT_TRACE_SDRE_START = 0x10,
+	BOOT_TRACE_SDRE_QUIESCE,
+	BOOT_TRACE_SDRE_STOP_MOTOR,
+	BOOT_TRACE_SDRE_XENOGC,
+	BOOT_TRACE_SDRE_RELOCATE,
+	BOOT_TRACE_SDRE_BSS,
+	BOOT_TRACE_SDRE_JUMP,
+};
+
+struct boot_trace_record {
+	uint32_t	ticks;
+	uint32_t	event;
+};
+
+struct boot_trace {
+	uint32_t	magic;
+	uint32_t	head;		/* records ever written */
+	uint32_t	nr_records;
+	uint32_t	ticks_per_sec;
+	struct boot_trace_record records[BOOT_TRACE_RECORDS];
+};
+
+#endif /* __BOOTTRACE_H */
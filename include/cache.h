@@ -0,0 +1,44 @@
+/*
+ * cache.h
+ *
+ * Content addressed cache of build artifacts.
+ * Copyright (C) 2005-2006 The GameCube Linux Team
+ * Copyright (C) 2005,2006 Albert Herranz
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ */
+
+#ifndef __CACHE_H
+#define __CACHE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+/* directory holding the cache, no caching if unset */
+#define CACHE_ENV		"CUBEBOOT_CACHE"
+
+struct cache_key {
+	uint32_t state[8];	/* sha-256 of everything added */
+	uint64_t length;
+	unsigned char block[64];
+
+	char name[65];		/* hex digest, once looked up */
+};
+
+void cache_key_init(struct cache_key *key, const char *tool,
+		    const char *version);
+void cache_key_add(struct cache_key *key, const void *data, size_t size);
+void cache_key_add_string(struct cache_key *key, const char *s);
+void cache_key_add_file(struct cache_key *key, const char *filename);
+
+int cache_enabled(void);
+int cache_fetch(struct cache_key *key, const char *outfile);
+void cache_store(struct cache_key *key, const char *outfile);
+void cache_report(FILE *f);
+
+#endif /* __CACHE_H */
@@ -0,0 +1,139 @@
+/*
+ * cubeboot.h
+ *
+ * libcubeboot, the cubeboot-tools as a library.
+ * Copyright (C) 2005-2006 The GameCube Linux Team
+ * Copyright (C) 2005,2006 Albert Herranz
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ */
+
+/*
+ * All functions are reentrant: they keep no state between calls, never
+ * allocate memory and never exit. Output goes to buffers supplied by
+ * the caller.
+ * Errors are reported as negative CB_E* codes.
+ */
+
+#ifndef __CUBEBOOT_H
+#define __CUBEBOOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "gcm.h"
+#include "bnr.h"
+#include "dolrel.h"
+
+#define CB_OK		0
+#define CB_EINVAL	-1	/* bad argument */
+#define CB_ENOSPC	-2	/* output buffer too small */
+#define CB_EOVERFLOW	-3	/* doesn't fit in the system area */
+#define CB_EFORMAT	-4	/* malformed input */
+#define CB_EVERSION	-5	/* relocation engine of another version */
+#define CB_EOVERLAP	-6	/* would overwrite the engine or its stack */
+#define CB_ENOROOM	-7	/* no free memory to relocate through */
+
+const char *cb_strerror(int error);
+const char *cb_build_id(void);
+
+/*
+ * Generic Boot Image (the disc system area).
+ */
+void cb_gbi_defaults(struct gcm_system_area *sa);
+int cb_gbi_set(struct gcm_system_area *sa, const char *key,
+	       const char *value);
+int cb_gbi_check(const struct gcm_system_area *sa);
+uint32_t cb_gbi_banner_offset(const struct gcm_system_area *sa);
+int cb_gbi_build(const struct gcm_system_area *sa, void *buf, size_t size);
+int cb_fst_single_file(const char *fname, uint32_t flen, void *buf,
+		       size_t size, size_t *fst_size);
+
+/*
+ * Self relocatable DOLs.
+ * The relocation engine is sdre.bin, its placeholder control block
+ * included. cb_dolrel_check() needs a CB_MEM1_SIZE scratch buffer.
+ */
+#define CB_MEM1_SIZE	(24 * 1024 * 1024)
+
+#define CB_PLACE_LOW	0	/* stage the sections as low as possible */
+#define CB_PLACE_HIGH	1	/* or as high as possible */
+
+/* a good minimum length for the zero runs cleared rather than stored */
+#define CB_DOLREL_ZERO_RUN	4096
+
+struct cb_dolrel_options {
+	unsigned long flags;	/* DOLREL_FLAG_*, for the engine */
+	int compress;		/* compress the sections */
+	int placement;		/* CB_PLACE_* */
+	uint32_t zero_run;	/* clear zero runs this long, 0 for none */
+};
+
+/* the memory used by a relocatable DOL, as [start, end) ranges */
+struct cb_dolrel_step {
+	uint32_t dst, length, packed_length, src;
+	uint32_t flags;		/* DOLREL_SECTION_* */
+};
+
+struct cb_dolrel_map {
+	uint32_t engine_start, engine_end;
+	uint32_t stack_start, stack_end;
+	uint32_t data_start, data_end;
+	uint32_t bss_start, bss_end;
+	uint32_t entry_point;
+	int nr_steps;
+	struct cb_dolrel_step steps[DOLREL_MAX_SECTIONS];
+};
+
+int cb_dolrel(const void *dol, size_t dol_size,
+	      const void *engine, size_t engine_size,
+	      const struct cb_dolrel_options *options,
+	      void *buf, size_t size, size_t *out_size);
+int cb_dolrel_map(const void *rel, size_t rel_size, size_t engine_size,
+		  struct cb_dolrel_map *map);
+int cb_dolrel_check(const void *rel, size_t rel_size, size_t engine_size,
+		    const void *dol, size_t dol_size,
+		    void *scratch, size_t scratch_size);
+
+/*
+ * Banners, from and to 8 bit RGB pixels (BNR_WIDTH x BNR_HEIGHT).
+ */
+#define CB_BNR_RGB_SIZE	(BNR_WIDTH * BNR_HEIGHT * 3)
+#define CB_BNR_SIZE	(sizeof(struct banner_header) + \
+			 BNR_WIDTH * BNR_HEIGHT * 2 + \
+			 sizeof(struct banner_description))
+
+int cb_bnr_encode(const unsigned char *rgb,
+		  const struct banner_description *bd, void *buf,
+		  size_t size);
+int cb_bnr_decode(const void *bnr, size_t bnr_size, unsigned char *rgb,
+		  size_t size);
+
+/*
+ * GameCube Master (disc image) parsing.
+ */
+struct cb_gcm_info {
+	struct gcm_disk_header dh;
+	struct gcm_disk_header_info dhi;
+	struct gcm_apploader_header ah;
+};
+
+struct cb_gcm_fst {
+	const struct gcm_file_entry *entries;
+	uint32_t nr_entries;
+	const char *string_table;
+	size_t string_table_size;
+};
+
+int cb_gcm_parse(const void *image, size_t size, struct cb_gcm_info *info);
+int cb_gcm_fst(const void *image, size_t size,
+	       const struct gcm_disk_header *dh, struct cb_gcm_fst *fst);
+const char *cb_gcm_entry_name(const struct cb_gcm_fst *fst,
+			      const struct gcm_file_entry *fe);
+
+#endif /* __CUBEBOOT_H */
@@ -18,24 +18,60 @@
 #include <sys/types.h>
 #include <stdint.h>
 
+/* must match between udolrel and the relocation engine */
+#define DOLREL_VERSION	0xdead0005
+
 #define DOLREL_FLAG_STOP_MOTOR     (1<<0)
 #define DOLREL_FLAG_DISABLE_XENOGC (1<<1)
 
+/* kinds of relocation steps, telling the cache maintenance needed */
+#define DOLREL_SECTION_DATA	0
+#define DOLREL_SECTION_TEXT	(1<<0)	/* code, the icache is refreshed */
+#define DOLREL_SECTION_ZERO	(1<<1)	/* cleared, there is no source */
+
+/*
+ * The DOL sections, split around the zero runs cleared instead of stored,
+ * plus a move out of the way for each stored piece.
+ */
+#define DOLREL_MAX_SECTIONS	64
+
+/*
+ * A step of the relocation plan, run in table order.
+ * It reads packed_length bytes at src_address, compressed (see lz.h)
+ * unless packed_length equals length. Uncompressed steps may overlap
+ * their own source.
+ */
 struct dolrel_section {
-	void	*dst_address;
-	size_t	length;
+	void		*dst_address;
+	size_t		length;
+	size_t		packed_length;
+	void		*src_address;
+	unsigned long	flags;		/* DOLREL_SECTION_* */
 };
 
+/*
+ * The relocation table is part of the control block, so the engine .bss,
+ * cleared on startup, comes after it. engine_end tells where it ends.
+ */
 struct dolrel_control {
 	uint32_t	version;
 	unsigned long	flags;
 	void		*entry_point;
 	void		*address_bss;
 	uint32_t	size_bss;
-	void		*src_address;
+	void		*engine_end;
 	uint32_t	nr_sections;
+	struct dolrel_section sections[DOLREL_MAX_SECTIONS];
 };
 
+/*
+ * Sizes of the structures above on the GameCube, where pointers and
+ * longs are 32 bits wide. Host tools write them word by word.
+ */
+#define DOLREL_SECTION_SIZE	(5 * 4)
+#define DOLREL_CONTROL_SIZE	(7 * 4 + \
+				 DOLREL_MAX_SECTIONS * DOLREL_SECTION_SIZE)
+
 extern struct dolrel_control __dolrel_control;
 
 #endif /* __DOLREL_H */
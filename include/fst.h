@@ -0,0 +1,53 @@
+/*
+ * fst.h
+ *
+ * GameCube file system table builder.
+ * Copyright (C) 2005-2006 The GameCube Linux Team
+ * Copyright (C) 2005,2006 Albert Herranz
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ */
+
+#ifndef __FST_H
+#define __FST_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+struct fst_node {
+	char *name;
+	char *path;		/* directories only */
+	int is_dir;
+	off_t size;
+
+	struct fst_node *parent;
+	struct fst_node **children;	/* sorted by name */
+	unsigned int nr_children;
+
+	uint32_t disk_offset;
+	int located;
+
+	uint32_t index;		/* in the file entry table */
+	uint32_t next_index;	/* first entry past this directory */
+
+	void *data;		/* owned by the image writer */
+};
+
+struct fst_node *fst_scan_tree(const char *root, int nr_threads);
+void fst_free_tree(struct fst_node *root);
+
+struct fst_node *fst_add_file(struct fst_node *dir, const char *name,
+			      off_t size, uint32_t disk_offset);
+
+void fst_locate_in_image(struct fst_node *root, int image_fd);
+
+char *fst_node_path(struct fst_node *node);
+
+uint32_t fst_layout_size(struct fst_node *root);
+void *fst_build(struct fst_node *root, uint32_t *fst_size);
+
+#endif /* __FST_H */
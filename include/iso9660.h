@@ -0,0 +1,186 @@
+/*
+ * iso9660.h
+ *
+ * ISO 9660 volume structures.
+ * Copyright (C) 2005-2006 The GameCube Linux Team
+ * Copyright (C) 2005,2006 Albert Herranz
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ */
+
+#ifndef __ISO9660_H
+#define __ISO9660_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define ISO_SECTOR_SIZE		2048
+
+/* volume descriptors start right after the system area */
+#define ISO_VD_SECTOR		16
+
+#define ISO_VD_BOOT_RECORD	0
+#define ISO_VD_PRIMARY		1
+#define ISO_VD_END		255
+
+#define ISO_STANDARD_ID		"CD001"
+
+/* directory record flags */
+#define ISO_FLAG_HIDDEN		0x01
+#define ISO_FLAG_DIRECTORY	0x02
+#define ISO_FLAG_MULTI_EXTENT	0x80
+
+/*
+ * Numbers are stored as arrays of bytes, most of them in both byte orders
+ * (little endian first).
+ */
+struct iso_directory_record {
+	uint8_t length;
+	uint8_t ext_attr_length;
+	uint8_t extent[8];
+	uint8_t size[8];
+	uint8_t date[7];
+	uint8_t flags;
+	uint8_t file_unit_size;
+	uint8_t interleave;
+	uint8_t volume_sequence_number[4];
+	uint8_t name_len;
+	char name[0];
+} __attribute__ ((__packed__));
+
+struct iso_primary_descriptor {
+	uint8_t type;
+	char id[5];
+	uint8_t version;
+	uint8_t unused1;
+	char system_id[32];
+	char volume_id[32];
+	uint8_t unused2[8];
+	uint8_t volume_space_size[8];
+	uint8_t unused3[32];
+	uint8_t volume_set_size[4];
+	uint8_t volume_sequence_number[4];
+	uint8_t logical_block_size[4];
+	uint8_t path_table_size[8];
+	uint8_t type_l_path_table[4];
+	uint8_t opt_type_l_path_table[4];
+	uint8_t type_m_path_table[4];
+	uint8_t opt_type_m_path_table[4];
+	uint8_t root_directory_record[34];
+	char volume_set_id[128];
+	char publisher_id[128];
+	char preparer_id[128];
+	char application_id[128];
+	char copyright_file_id[37];
+	char abstract_file_id[37];
+	char bibliographic_file_id[37];
+	char creation_date[17];
+	char modification_date[17];
+	char expiration_date[17];
+	char effective_date[17];
+	uint8_t file_structure_version;
+	uint8_t unused4;
+	uint8_t application_data[512];
+	uint8_t unused5[653];
+} __attribute__ ((__packed__));
+
+/* "El Torito" boot record volume descriptor */
+struct iso_boot_record {
+	uint8_t type;
+	char id[5];
+	uint8_t version;
+	char boot_system_id[32];
+	char boot_id[32];
+	uint8_t boot_catalog[4];	/* 7.3.1 */
+	uint8_t unused[1973];
+} __attribute__ ((__packed__));
+
+#define ELTORITO_SYSTEM_ID	"EL TORITO SPECIFICATION"
+
+struct eltorito_validation_entry {
+	uint8_t header_id;	/* 1 */
+	uint8_t platform_id;
+	uint8_t reserved[2];
+	char id_string[24];
+	uint8_t checksum[2];
+	uint8_t key_55;
+	uint8_t key_aa;
+} __attribute__ ((__packed__));
+
+struct eltorito_default_entry {
+	uint8_t boot_indicator;	/* 0x88 */
+	uint8_t boot_media_type;	/* 0 = no emulation */
+	uint8_t load_segment[2];
+	uint8_t system_type;
+	uint8_t unused1;
+	uint8_t sector_count[2];	/* 512 byte sectors */
+	uint8_t load_rba[4];
+	uint8_t unused2[20];
+} __attribute__ ((__packed__));
+
+#define ELTORITO_BOOTABLE	0x88
+
+/*
+ * Reads the little endian half of a 7.3.1 or 7.3.3 number.
+ */
+static inline uint32_t iso_733(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void iso_set_721(uint8_t *p, uint16_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static inline void iso_set_722(uint8_t *p, uint16_t v)
+{
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+static inline void iso_set_723(uint8_t *p, uint16_t v)
+{
+	iso_set_721(p, v);
+	iso_set_722(p + 2, v);
+}
+
+static inline void iso_set_731(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static inline void iso_set_732(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static inline void iso_set_733(uint8_t *p, uint32_t v)
+{
+	iso_set_731(p, v);
+	iso_set_732(p + 4, v);
+}
+
+struct fst_node;
+struct iso_image;
+struct writer;
+
+struct iso_image *iso_layout(struct fst_node *tree, const char *boot_file,
+			     uint32_t fst_size);
+uint32_t iso_fst_offset(struct iso_image *iso);
+void iso_write(struct iso_image *iso, struct writer *w, void *fst);
+void iso_seek_report(struct iso_image *iso, FILE *f, uint32_t head);
+void iso_free(struct iso_image *iso);
+
+#endif /* __ISO9660_H */
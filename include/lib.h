@@ -36,8 +36,37 @@ void die(char *fmt, ...);
 void *xmalloc(size_t size);
 void *xrealloc(void *ptr, size_t size);
 
-int pad_file(int fd, int size);
-char *slurp_file(const char *filename, off_t * r_size);
+ssize_t write_full(int fd, const void *buf, size_t count);
+
+struct writer {
+	int fd;
+	char *buf;
+	size_t size;		/* of the buffer */
+	size_t used;
+	off_t offset;		/* of the next byte, in the output */
+};
+
+#define WRITER_BUFFER_SIZE	(64 * 1024)
+
+void writer_init(struct writer *w, int fd, size_t size);
+int writer_write(struct writer *w, const void *data, size_t count);
+int writer_pad(struct writer *w, size_t count, int c);
+int writer_pad_to(struct writer *w, off_t offset, int c);
+int writer_align_to(struct writer *w, size_t alignment, int c);
+int writer_flush(struct writer *w);
+int writer_release(struct writer *w);
+
+struct mapped_file {
+	void *data;
+	off_t size;
+	int mapped;		/* else read in a malloced buffer */
+};
+
+int try_map_fd(int fd, struct mapped_file *mf);
+int try_read_fd(int fd, struct mapped_file *mf);
+void map_fd(int fd, const char *filename, struct mapped_file *mf);
+void map_file(const char *filename, struct mapped_file *mf);
+void unmap_file(struct mapped_file *mf);
 
 #endif /* __LIB_H */
 
@@ -0,0 +1,99 @@
+/*
+ * lz.h
+ *
+ * LZ compression of relocated DOL sections.
+ * Copyright (C) 2005-2006 The GameCube Linux Team
+ * Copyright (C) 2005,2006 Albert Herranz
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ */
+
+/*
+ * A compressed section is a series of sequences, each one made of:
+ * - a token byte, with the number of literals in its high nibble and
+ *   the match length minus LZ_MIN_MATCH in the low one. A nibble of 15
+ *   is followed by extra length bytes, added to it up to and including
+ *   the first one which is not 255.
+ * - the literals.
+ * - the match offset, 16 bits big endian, counted back from the current
+ *   output position. The last sequence stops after its literals.
+ *
+ * The decoder is shared by the host tools and the relocation engine.
+ */
+
+#ifndef __LZ_H
+#define __LZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LZ_MIN_MATCH	4
+#define LZ_MAX_OFFSET	0xffff
+
+/*
+ * Decompresses src into exactly dst_len bytes at dst.
+ * Returns 0 on success, -1 if the data is malformed.
+ */
+static inline int lz_decompress(unsigned char *dst, uint32_t dst_len,
+				const unsigned char *src, uint32_t src_len)
+{
+	const unsigned char *ip = src, *iend = src + src_len, *match;
+	unsigned char *op = dst, *oend = dst + dst_len;
+	unsigned int token, c;
+	uint32_t len, offset;
+
+	while (ip < iend) {
+		token = *ip++;
+
+		/* literals */
+		len = token >> 4;
+		if (len == 15) {
+			do {
+				if (ip == iend)
+					return -1;
+				c = *ip++;
+				len += c;
+			} while (c == 255);
+		}
+		if (len > iend - ip || len > oend - op)
+			return -1;
+		while (len--)
+			*op++ = *ip++;
+		if (ip == iend)
+			break;
+
+		/* match */
+		if (iend - ip < 2)
+			return -1;
+		offset = (ip[0] << 8) | ip[1];
+		ip += 2;
+		if (offset == 0 || offset > op - dst)
+			return -1;
+		len = token & 15;
+		if (len == 15) {
+			do {
+				if (ip == iend)
+					return -1;
+				c = *ip++;
+				len += c;
+			} while (c == 255);
+		}
+		len += LZ_MIN_MATCH;
+		if (len > oend - op)
+			return -1;
+		match = op - offset;
+		while (len--)
+			*op++ = *match++;
+	}
+	return (op == oend) ? 0 : -1;
+}
+
+/* host only */
+size_t lz_compress(const unsigned char *src, size_t len,
+		   unsigned char *dst, size_t dst_size);
+
+#endif /* __LZ_H */
@@ -0,0 +1,114 @@
+/**
+ * bnr.c
+ *
+ * Nintendo GameCube .BNR encoder and decoder.
+ * This program is part of the cubeboot-tools package.
+ *
+ * Copyright (C) 2005-2006 The GameCube Linux Team
+ * Copyright (C) 2005,2006 Albert Herranz
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ */
+
+/*
+ * The banner image is made of 4x4 pixel tiles, left to right and top to
+ * bottom. Pixels are big endian RGB5A3 with the alpha bit set (RGB555).
+ */
+
+#include <string.h>
+
+#include "../include/lib.h"
+#include "../include/cubeboot.h"
+
+#define BNR_TILE_SIDE	4
+
+/*
+ * Returns the position of the tile pixel number i in a raster.
+ */
+static int bnr_pixel_pos(int i)
+{
+	int tile = i / BNR_TILE_SIZE, in_tile = i % BNR_TILE_SIZE;
+	int tiles_per_row = BNR_WIDTH / BNR_TILE_SIDE;
+	int row, col;
+
+	row = (tile / tiles_per_row) * BNR_TILE_SIDE + in_tile / BNR_TILE_SIDE;
+	col = (tile % tiles_per_row) * BNR_TILE_SIDE + in_tile % BNR_TILE_SIDE;
+	return row * BNR_WIDTH + col;
+}
+
+/*
+ * Builds a banner file of CB_BNR_SIZE bytes in buf.
+ */
+int cb_bnr_encode(const unsigned char *rgb,
+		  const struct banner_description *bd, void *buf,
+		  size_t size)
+{
+	struct banner_header *bh = buf;
+	uint16_t *outp;
+	const unsigned char *p;
+	unsigned int r, g, b;
+	int i;
+
+	if (size < CB_BNR_SIZE)
+		return CB_ENOSPC;
+
+	memset(bh, 0, sizeof(*bh));
+	memcpy(bh->magic, BNR_MAGIC1, 4);
+
+	outp = (uint16_t *)(bh + 1);
+	for (i = 0; i < BNR_WIDTH * BNR_HEIGHT; i++) {
+		p = rgb + 3 * bnr_pixel_pos(i);
+
+		/* convert from 8 to 5 bits */
+		r = (p[0] * (1<<5)) / 256;
+		g = (p[1] * (1<<5)) / 256;
+		b = (p[2] * (1<<5)) / 256;
+
+		*outp++ = cpu_to_be16((1<<15) | (r << 10) | (g << 5) | b);
+	}
+
+	memcpy(outp, bd, sizeof(*bd));
+
+	return CB_OK;
+}
+
+/*
+ * Extracts the image of a banner as CB_BNR_RGB_SIZE bytes of RGB.
+ */
+int cb_bnr_decode(const void *bnr, size_t bnr_size, unsigned char *rgb,
+		  size_t size)
+{
+	const uint16_t *rgba;
+	unsigned char *outp;
+	unsigned int rgba_cpu, r, g, b;
+	int i;
+
+	if (bnr_size < sizeof(struct banner_header) +
+	    BNR_WIDTH * BNR_HEIGHT * sizeof(*rgba) ||
+	    (memcmp(bnr, BNR_MAGIC1, 4) && memcmp(bnr, BNR_MAGIC2, 4)))
+		return CB_EFORMAT;
+	if (size < CB_BNR_RGB_SIZE)
+		return CB_ENOSPC;
+
+	rgba = (const uint16_t *)(bnr + sizeof(struct banner_header));
+	for (i = 0; i < BNR_WIDTH * BNR_HEIGHT; i++) {
+		rgba_cpu = be16_to_cpu(rgba[i]);
+
+		/* retrieve components */
+		r = (rgba_cpu >> 10) & 0x1f;
+		g = (rgba_cpu >> 5) & 0x1f;
+		b = (rgba_cpu >> 0) & 0x1f;
+
+		/* aproximate to 8 bits */
+		outp = rgb + 3 * bnr_pixel_pos(i);
+		outp[0] = (r << 3) | (r >> 2);
+		outp[1] = (g << 3) | (g >> 2);
+		outp[2] = (b << 3) | (b >> 2);
+	}
+
+	return CB_OK;
+}
@@ -0,0 +1,798 @@
+/**
+ * dolrel.c
+ *
+ * Converts a zImage.dol into a self-relocatable lowmem .dol
+ * This program is part of the cubeboot-tools package.
+ *
+ * Copyright (C) 2005-2006 The GameCube Linux Team
+ * Copyright (C) 2005,2006 Albert Herranz
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ */
+
+/*
+ * The resulting .dol contains just two text sections:
+ * - a data section, with all original sections packed one after another
+ *   in ascending load address order, staged where it is in the way of
+ *   as little as possible
+ * - the relocation engine, ending with its control block and the plan
+ *   telling how to move each packed section to its place
+ *
+ * Sections may be compressed, each one on its own, and are then
+ * decompressed by the engine straight to their final place.
+ * Long runs of zeros are not stored at all, the engine clears them.
+ *
+ * The plan is ordered so that no packed section is overwritten before
+ * it has been moved. When sections overwrite each other's sources in a
+ * cycle, some of them are first moved out of the way, to free memory.
+ * Only the relocation engine itself must not be overwritten.
+ */
+
+#include <string.h>
+
+#include "../include/lib.h"
+#include "../include/dol.h"
+#include "../include/dolrel.h"
+#include "../include/lz.h"
+#include "../include/cubeboot.h"
+
+#define DOL_ALIGN_SIZE		32
+#define dol_align(size)		(((size) + DOL_ALIGN_SIZE - 1) & \
+				 ~(DOL_ALIGN_SIZE - 1))
+
+/* where the relocation engine is loaded */
+#define DOLREL_LOAD_ADDRESS	0x80003100
+
+#define DOLREL_PAD		0xaa
+
+#define MEM1_START		0x80000000
+#define MEM1_END		(MEM1_START + CB_MEM1_SIZE)
+
+/* the apploader runs from here, and won't load DOLs above it */
+#define DOLREL_LOAD_LIMIT	0x81200000
+
+/* the engine stack, set up in crt0.S, grows down from here */
+#define DOLREL_STACK_TOP	0x81600000
+#define DOLREL_STACK_SIZE	0x10000
+#define DOLREL_STACK_START	(DOLREL_STACK_TOP - DOLREL_STACK_SIZE)
+
+/* what cb_dolrel_check() leaves on the model of the engine stack */
+#define DOLREL_STACK_FILL	0x5a
+
+/* control block fields, as offsets */
+#define CONTROL_VERSION		0
+#define CONTROL_FLAGS		4
+#define CONTROL_ENTRY_POINT	8
+#define CONTROL_ADDRESS_BSS	12
+#define CONTROL_SIZE_BSS	16
+#define CONTROL_ENGINE_END	20
+#define CONTROL_NR_SECTIONS	24
+#define CONTROL_SECTIONS	28
+
+struct area {
+	uint32_t start, end;
+};
+
+/*
+ *
+ */
+static unsigned char *put_be32(unsigned char *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+	return p + 4;
+}
+
+/*
+ *
+ */
+static uint32_t get_be32(const unsigned char *p)
+{
+	return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+/*
+ *
+ */
+static int overlaps(uint32_t a, uint32_t a_len, uint32_t b, uint32_t b_len)
+{
+	return a_len && b_len && a < b + b_len && b < a + a_len;
+}
+
+/*
+ * Tells if [address, address + len) hits the engine or its stack.
+ */
+static int hits_engine(uint32_t address, uint32_t len, uint32_t engine_start,
+		       uint32_t engine_end)
+{
+	return overlaps(address, len, engine_start,
+			engine_end - engine_start) ||
+	    overlaps(address, len, DOLREL_STACK_START, DOLREL_STACK_SIZE);
+}
+
+/*
+ *
+ */
+static int in_mem1(uint32_t address, uint32_t len)
+{
+	return address >= MEM1_START && address <= MEM1_END &&
+	    len <= MEM1_END - address;
+}
+
+/*
+ * Reads a DOL header, checking that all its sections are in the file.
+ */
+static int read_dol_header(const void *dol, size_t dol_size,
+			   struct dol_header *dh)
+{
+	uint32_t words[DOL_HEADER_SIZE / sizeof(uint32_t)];
+	uint32_t offset, size;
+	int i;
+
+	if (dol_size < sizeof(words))
+		return CB_EFORMAT;
+
+	/* the header is packed, swap it in an aligned copy */
+	memcpy(words, dol, sizeof(words));
+	for (i = 0; i < DOL_HEADER_SIZE / sizeof(uint32_t); i++)
+		words[i] = be32_to_cpu(words[i]);
+	memcpy(dh, words, sizeof(*dh));
+
+	for (i = 0; i < DOL_MAX_SECT; i++) {
+		offset = dol_sect_offset(dh, i);
+		size = dol_sect_size(dh, i);
+		if (size && (offset > dol_size || size > dol_size - offset))
+			return CB_EFORMAT;
+	}
+	return CB_OK;
+}
+
+/*
+ *
+ */
+static int lowest_section(struct dol_header *dh, uint32_t pending)
+{
+	uint32_t lowest_start = 0xffffffff;
+	int i, j = -1;
+
+	for (i = 0; i < DOL_MAX_SECT; i++) {
+		if ((pending & (1 << i)) &&
+		    dol_sect_address(dh, i) < lowest_start) {
+			lowest_start = dol_sect_address(dh, i);
+			j = i;
+		}
+	}
+	return j;
+}
+
+/*
+ * Finds the first run of at least min zeros in p, if any.
+ * Returns its offset, or len, and its length in run.
+ */
+static uint32_t find_zero_run(const unsigned char *p, uint32_t len,
+			      uint32_t min, uint32_t *run)
+{
+	uint32_t i = 0, start;
+
+	*run = 0;
+	if (!min)
+		return len;
+	while (i < len) {
+		if (p[i]) {
+			i++;
+			continue;
+		}
+		start = i;
+		while (i < len && !p[i])
+			i++;
+		if (i - start >= min) {
+			*run = i - start;
+			return start;
+		}
+	}
+	return len;
+}
+
+/*
+ * Tells how long the piece of a section starting at offset is, and if
+ * it is a run of zeros to clear rather than store.
+ */
+static int next_piece(const unsigned char *src, uint32_t len,
+		      uint32_t offset, uint32_t zero_run, uint32_t *piece_len)
+{
+	uint32_t start, run;
+
+	start = offset + find_zero_run(src + offset, len - offset, zero_run,
+				       &run);
+	if (start > offset) {
+		*piece_len = start - offset;
+		return 0;
+	}
+	*piece_len = run;
+	return 1;
+}
+
+/*
+ * Counts the table entries a DOL may need once split on zero runs:
+ * one per run, and two per stored piece, which might have to be moved
+ * out of the way.
+ */
+static int count_entries(const void *dol, struct dol_header *dh,
+			 uint32_t zero_run)
+{
+	const unsigned char *src;
+	uint32_t offset, len, piece_len;
+	int i, nr_entries = 0;
+
+	for (i = 0; i < DOL_MAX_SECT; i++) {
+		src = dol + dol_sect_offset(dh, i);
+		len = dol_sect_size(dh, i);
+		for (offset = 0; offset < len; offset += piece_len) {
+			if (next_piece(src, len, offset, zero_run, &piece_len))
+				nr_entries += 1;
+			else
+				nr_entries += 2;
+		}
+	}
+	return nr_entries;
+}
+
+/*
+ * Tells if step i would write over step j's source.
+ */
+static int step_clobbers(struct cb_dolrel_step *steps, int i, int j)
+{
+	/* an uncompressed step may overwrite its own source */
+	if (i == j && steps[i].packed_length == steps[i].length)
+		return 0;
+	return overlaps(steps[i].dst, steps[i].length, steps[j].src,
+			steps[j].packed_length);
+}
+
+/*
+ * Tells if [address, address + size) is clear of every busy area.
+ */
+static int area_is_free(struct area *busy, int nr_busy, uint32_t address,
+			uint32_t size)
+{
+	int i;
+
+	for (i = 0; i < nr_busy; i++) {
+		if (overlaps(address, size, busy[i].start,
+			     busy[i].end - busy[i].start))
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Finds the lowest free place for size bytes, away from every busy area.
+ * It stays below DOLREL_LOAD_LIMIT, as the apploader left the fst and
+ * bi2 at the top of MEM1 for the payload.
+ */
+static int find_free_area(struct area *busy, int nr_busy, uint32_t size,
+			  uint32_t *address)
+{
+	uint32_t candidate;
+	int i;
+
+	*address = 0;
+	for (i = -1; i < nr_busy; i++) {
+		candidate = (i < 0) ? MEM1_START : dol_align(busy[i].end);
+		if (candidate < MEM1_START || candidate > DOLREL_LOAD_LIMIT ||
+		    size > DOLREL_LOAD_LIMIT - candidate)
+			continue;
+		if (area_is_free(busy, nr_busy, candidate, size) &&
+		    (!*address || candidate < *address))
+			*address = candidate;
+	}
+	return *address ? CB_OK : CB_ENOROOM;
+}
+
+/*
+ * Chooses where the apploader loads the packed sections: the lowest or
+ * highest place between the engine and the apploader clear of every busy
+ * area. Failing that, right after the engine, and the relocation plan
+ * takes care of the overlaps.
+ */
+static int place_data(struct area *busy, int nr_busy, uint32_t size,
+		      int placement, uint32_t engine_end, uint32_t *address)
+{
+	uint32_t low = dol_align(engine_end), candidate;
+	int found = 0, i;
+
+	if (size > DOLREL_LOAD_LIMIT || low > DOLREL_LOAD_LIMIT - size)
+		return CB_ENOROOM;
+
+	/* a free area starts right after a busy one, or ends right before */
+	for (i = -1; i < nr_busy; i++) {
+		if (placement == CB_PLACE_HIGH) {
+			candidate = (i < 0) ? DOLREL_LOAD_LIMIT : busy[i].start;
+			if (candidate < low + size)
+				continue;
+			candidate = (candidate - size) & ~(DOL_ALIGN_SIZE - 1);
+			if (found && candidate <= *address)
+				continue;
+		} else {
+			candidate = (i < 0) ? low : dol_align(busy[i].end);
+			if (candidate < low ||
+			    candidate > DOLREL_LOAD_LIMIT - size)
+				continue;
+			if (found && candidate >= *address)
+				continue;
+		}
+		if (area_is_free(busy, nr_busy, candidate, size)) {
+			*address = candidate;
+			found = 1;
+		}
+	}
+	if (!found)
+		*address = low;
+	return CB_OK;
+}
+
+/*
+ * Orders the relocation steps so that every source is read before
+ * anything is written over it, moving sources out of the way to break
+ * cycles. Steps keep their ascending address order when possible.
+ * busy holds every area in use, with room for one more per move.
+ */
+static int plan_relocation(struct cb_dolrel_step *sections,
+			   int nr_sections, struct area *busy, int nr_busy,
+			   struct cb_dolrel_step *plan, int *nr_steps)
+{
+	int done[DOLREL_MAX_SECTIONS];
+	int remaining = nr_sections, error, i, j, k;
+	uint32_t scratch, size;
+
+	memset(done, 0, sizeof(done));
+	*nr_steps = 0;
+
+	while (remaining > 0) {
+		/* the first step not overwriting a pending source */
+		for (i = 0; i < nr_sections; i++) {
+			if (done[i])
+				continue;
+			for (j = 0; j < nr_sections; j++) {
+				if (!done[j] && step_clobbers(sections, i, j))
+					break;
+			}
+			if (j == nr_sections)
+				break;
+		}
+		if (i < nr_sections) {
+			plan[(*nr_steps)++] = sections[i];
+			done[i] = 1;
+			remaining--;
+			continue;
+		}
+
+		/* a cycle, move the smallest source in the way elsewhere */
+		k = -1;
+		for (j = 0; j < nr_sections; j++) {
+			if (done[j])
+				continue;
+			for (i = 0; i < nr_sections; i++) {
+				if (!done[i] && step_clobbers(sections, i, j))
+					break;
+			}
+			if (i < nr_sections && (k < 0 ||
+			    sections[j].packed_length <
+			    sections[k].packed_length))
+				k = j;
+		}
+
+		size = dol_align(sections[k].packed_length);
+		error = find_free_area(busy, nr_busy, size, &scratch);
+		if (error)
+			return error;
+		busy[nr_busy].start = scratch;
+		busy[nr_busy].end = scratch + size;
+		nr_busy++;
+
+		plan[*nr_steps].dst = scratch;
+		plan[*nr_steps].length = sections[k].packed_length;
+		plan[*nr_steps].packed_length = sections[k].packed_length;
+		plan[*nr_steps].src = sections[k].src;
+		plan[*nr_steps].flags = DOLREL_SECTION_DATA;
+		(*nr_steps)++;
+		sections[k].src = scratch;
+	}
+	return CB_OK;
+}
+
+/*
+ * Builds the self relocatable version of a DOL in buf.
+ * The size of the result is returned in out_size, even if buf is too
+ * small for it (CB_ENOSPC), so the caller can size its buffer with a
+ * first call. When compressing, that first answer is an upper bound.
+ */
+int cb_dolrel(const void *dol, size_t dol_size,
+	      const void *engine, size_t engine_size,
+	      const struct cb_dolrel_options *options,
+	      void *buf, size_t size, size_t *out_size)
+{
+	struct dol_header header, *dh = &header, *new_dol = buf;
+	struct cb_dolrel_step sections[DOLREL_MAX_SECTIONS];
+	struct cb_dolrel_step plan[DOLREL_MAX_SECTIONS];
+	struct area busy[6 + DOL_MAX_SECT + DOLREL_MAX_SECTIONS];
+	const unsigned char *control, *src;
+	unsigned char *p, *data;
+	uint32_t total_sects_size, packed_size, reloc_code_size;
+	uint32_t aligned_packed_size, aligned_code_size;
+	uint32_t load_address_code, load_address_data, engine_end;
+	uint32_t len, packed_len, pending, offset, piece_len;
+	uint32_t zero_run, max_run, run;
+	int nr_sections, nr_steps, nr_busy;
+	int error, i, j;
+
+	*out_size = 0;
+	error = read_dol_header(dol, dol_size, dh);
+	if (error)
+		return error;
+	if (engine_size < DOLREL_CONTROL_SIZE)
+		return CB_EINVAL;
+
+	/* the engine image ends with a placeholder for its control block */
+	reloc_code_size = engine_size - DOLREL_CONTROL_SIZE;
+	control = engine + reloc_code_size;
+	if (get_be32(control + CONTROL_VERSION) != DOLREL_VERSION)
+		return CB_EVERSION;
+
+	pending = 0;
+	total_sects_size = 0;
+	for (i = 0; i < DOL_MAX_SECT; i++) {
+		if (dol_sect_size(dh, i)) {
+			if (!in_mem1(dol_sect_address(dh, i),
+				     dol_sect_size(dh, i)))
+				return CB_EFORMAT;
+			pending |= 1 << i;
+			total_sects_size += dol_sect_size(dh, i);
+		}
+	}
+	if (dh->size_bss && !in_mem1(dh->address_bss, dh->size_bss))
+		return CB_EFORMAT;
+
+	aligned_code_size = dol_align(engine_size);
+
+	/* compressed sections are never bigger than the original ones */
+	*out_size = sizeof(*new_dol) + dol_align(total_sects_size) +
+	    aligned_code_size;
+	if (size < *out_size)
+		return CB_ENOSPC;
+
+	/* the relocation stub will be loaded at this address */
+	load_address_code = DOLREL_LOAD_ADDRESS;
+
+	/* the engine code, data and .bss */
+	engine_end = get_be32(control + CONTROL_ENGINE_END);
+	if (engine_end < load_address_code + aligned_code_size)
+		engine_end = load_address_code + aligned_code_size;
+
+	/* memory the packed sections should stay clear of */
+	nr_busy = 0;
+	busy[nr_busy].start = MEM1_START;
+	busy[nr_busy++].end = load_address_code;
+	busy[nr_busy].start = load_address_code;
+	busy[nr_busy++].end = engine_end;
+	busy[nr_busy].start = DOLREL_STACK_START;
+	busy[nr_busy++].end = DOLREL_STACK_TOP;
+	if (dh->size_bss) {
+		busy[nr_busy].start = dh->address_bss;
+		busy[nr_busy++].end = dh->address_bss + dh->size_bss;
+	}
+	for (i = 0; i < DOL_MAX_SECT; i++) {
+		if (!dol_sect_size(dh, i))
+			continue;
+		busy[nr_busy].start = dol_sect_address(dh, i);
+		busy[nr_busy++].end = dol_sect_address(dh, i) +
+		    dol_sect_size(dh, i);
+	}
+
+	/*
+	 * Only the longest zero runs get cleared if the table is short:
+	 * look for the lowest minimum length that fits. No run is as long
+	 * as max_run, so the table always fits with it.
+	 */
+	zero_run = options->zero_run;
+	if (zero_run && count_entries(dol, dh, zero_run) >
+	    DOLREL_MAX_SECTIONS) {
+		max_run = CB_MEM1_SIZE + 1;
+		while (max_run - zero_run > 1) {
+			run = zero_run + (max_run - zero_run) / 2;
+			if (count_entries(dol, dh, run) > DOLREL_MAX_SECTIONS)
+				zero_run = run;
+			else
+				max_run = run;
+		}
+		zero_run = (max_run > CB_MEM1_SIZE) ? 0 : max_run;
+	}
+
+	/* all sections, packed in the new .dol data section */
+	data = p = (unsigned char *)(new_dol + 1);
+	nr_sections = 0;
+	while ((j = lowest_section(dh, pending)) >= 0) {
+		pending &= ~(1 << j);
+
+		src = dol + dol_sect_offset(dh, j);
+		len = dol_sect_size(dh, j);
+
+		for (offset = 0; offset < len; offset += piece_len) {
+			sections[nr_sections].dst = dol_sect_address(dh, j) +
+			    offset;
+			if (next_piece(src, len, offset, zero_run,
+				       &piece_len)) {
+				sections[nr_sections].length = piece_len;
+				sections[nr_sections].packed_length = 0;
+				sections[nr_sections].src = 0;
+				sections[nr_sections].flags =
+				    DOLREL_SECTION_ZERO;
+				nr_sections++;
+				continue;
+			}
+
+			/* compressed data must be smaller to be worth it */
+			packed_len = 0;
+			if (options->compress)
+				packed_len = lz_compress(src + offset,
+							 piece_len, p,
+							 piece_len - 1);
+			if (!packed_len) {
+				memcpy(p, src + offset, piece_len);
+				packed_len = piece_len;
+			}
+
+			sections[nr_sections].length = piece_len;
+			sections[nr_sections].packed_length = packed_len;
+			sections[nr_sections].src = p - data;
+			sections[nr_sections].flags =
+			    dol_sect_is_text(dh, j) ?
+			    DOLREL_SECTION_TEXT : DOLREL_SECTION_DATA;
+			nr_sections++;
+
+			p += packed_len;
+		}
+	}
+	packed_size = p - data;
+	aligned_packed_size = dol_align(packed_size);
+
+	error = place_data(busy, nr_busy, aligned_packed_size,
+			   options->placement, engine_end, &load_address_data);
+	if (error)
+		return error;
+	for (i = 0; i < nr_sections; i++) {
+		if (!(sections[i].flags & DOLREL_SECTION_ZERO))
+			sections[i].src += load_address_data;
+	}
+
+	/*
+	 * Nothing may be written over the engine or its stack while it
+	 * runs, and the stack would trash packed sections loaded under it.
+	 */
+	for (i = 0; i < nr_sections; i++) {
+		if (hits_engine(sections[i].dst, sections[i].length,
+				load_address_code, engine_end))
+			return CB_EOVERLAP;
+	}
+	if ((dh->size_bss && hits_engine(dh->address_bss, dh->size_bss,
+					 load_address_code, engine_end)) ||
+	    hits_engine(load_address_data, aligned_packed_size,
+			load_address_code, engine_end))
+		return CB_EOVERLAP;
+
+	/* sources may not be moved over the packed sections either */
+	busy[nr_busy].start = load_address_data;
+	busy[nr_busy++].end = load_address_data + aligned_packed_size;
+
+	error = plan_relocation(sections, nr_sections, busy, nr_busy,
+				plan, &nr_steps);
+	if (error)
+		return error;
+
+	/* data section padding */
+	memset(p, DOLREL_PAD, aligned_packed_size - packed_size);
+	p += aligned_packed_size - packed_size;
+
+	/* this is the new .dol header */
+	memset(new_dol, 0, sizeof(*new_dol));
+
+	new_dol->address_text[0] = cpu_to_be32(load_address_data);
+	new_dol->offset_text[0] = cpu_to_be32(sizeof(*new_dol));
+	new_dol->size_text[0] = cpu_to_be32(aligned_packed_size);
+
+	new_dol->address_text[1] = cpu_to_be32(load_address_code);
+	new_dol->offset_text[1] = cpu_to_be32(sizeof(*new_dol) +
+					      aligned_packed_size);
+	new_dol->size_text[1] = cpu_to_be32(aligned_code_size);
+
+	/* we don't need a bss section here */
+	new_dol->size_bss = 0;
+	new_dol->address_bss = 0;
+
+	/* our entry point becomes our relocation stub */
+	new_dol->entry_point = cpu_to_be32(load_address_code);
+
+	/* stub code */
+	memcpy(p, engine, reloc_code_size);
+	p += reloc_code_size;
+
+	/* stub control header */
+	p = put_be32(p, DOLREL_VERSION);
+	p = put_be32(p, options->flags);
+	p = put_be32(p, dh->entry_point);
+	p = put_be32(p, dh->address_bss);
+	p = put_be32(p, dh->size_bss);
+	p = put_be32(p, engine_end);
+	p = put_be32(p, nr_steps);
+
+	/* stub relocation plan */
+	for (i = 0; i < DOLREL_MAX_SECTIONS; i++) {
+		if (i < nr_steps) {
+			p = put_be32(p, plan[i].dst);
+			p = put_be32(p, plan[i].length);
+			p = put_be32(p, plan[i].packed_length);
+			p = put_be32(p, plan[i].src);
+			p = put_be32(p, plan[i].flags);
+		} else {
+			memset(p, 0, DOLREL_SECTION_SIZE);
+			p += DOLREL_SECTION_SIZE;
+		}
+	}
+
+	/* code section padding */
+	memset(p, DOLREL_PAD, aligned_code_size - engine_size);
+
+	*out_size = sizeof(*new_dol) + aligned_packed_size +
+	    aligned_code_size;
+	return CB_OK;
+}
+
+/*
+ * Tells where a relocatable DOL built by cb_dolrel() puts everything,
+ * reading it back from its header and engine control block.
+ */
+int cb_dolrel_map(const void *rel, size_t rel_size, size_t engine_size,
+		  struct cb_dolrel_map *map)
+{
+	struct dol_header header, *rh = &header;
+	const unsigned char *control, *entry;
+	int error, i;
+
+	error = read_dol_header(rel, rel_size, rh);
+	if (error)
+		return error;
+	if (engine_size < DOLREL_CONTROL_SIZE ||
+	    dol_sect_size(rh, 1) < engine_size)
+		return CB_EFORMAT;
+
+	control = rel + dol_sect_offset(rh, 1) + engine_size -
+	    DOLREL_CONTROL_SIZE;
+	if (get_be32(control + CONTROL_VERSION) != DOLREL_VERSION)
+		return CB_EVERSION;
+
+	map->engine_start = dol_sect_address(rh, 1);
+	map->engine_end = get_be32(control + CONTROL_ENGINE_END);
+	map->stack_start = DOLREL_STACK_START;
+	map->stack_end = DOLREL_STACK_TOP;
+	map->data_start = dol_sect_address(rh, 0);
+	map->data_end = map->data_start + dol_sect_size(rh, 0);
+	map->bss_start = get_be32(control + CONTROL_ADDRESS_BSS);
+	map->bss_end = map->bss_start + get_be32(control + CONTROL_SIZE_BSS);
+	map->entry_point = get_be32(control + CONTROL_ENTRY_POINT);
+
+	map->nr_steps = get_be32(control + CONTROL_NR_SECTIONS);
+	if (map->nr_steps < 0 || map->nr_steps > DOLREL_MAX_SECTIONS)
+		return CB_EFORMAT;
+	entry = control + CONTROL_SECTIONS;
+	for (i = 0; i < map->nr_steps; i++, entry += DOLREL_SECTION_SIZE) {
+		map->steps[i].dst = get_be32(entry);
+		map->steps[i].length = get_be32(entry + 4);
+		map->steps[i].packed_length = get_be32(entry + 8);
+		map->steps[i].src = get_be32(entry + 12);
+		map->steps[i].flags = get_be32(entry + 16);
+	}
+	return CB_OK;
+}
+
+/*
+ * Runs a relocatable DOL built by cb_dolrel() on a model of the GameCube
+ * memory, as the apploader and the engine would, and checks that the
+ * original DOL comes out of it and the engine survives.
+ * scratch holds the model, it must be at least CB_MEM1_SIZE bytes.
+ */
+int cb_dolrel_check(const void *rel, size_t rel_size, size_t engine_size,
+		    const void *dol, size_t dol_size,
+		    void *scratch, size_t scratch_size)
+{
+	struct dol_header header, *dh = &header;
+	struct dol_header rel_header, *rh = &rel_header;
+	struct cb_dolrel_map map;
+	struct cb_dolrel_step *step;
+	unsigned char *mem = scratch;
+	uint32_t len, address;
+	int error, i;
+
+	if (scratch_size < CB_MEM1_SIZE)
+		return CB_ENOSPC;
+	error = read_dol_header(dol, dol_size, dh);
+	if (!error)
+		error = read_dol_header(rel, rel_size, rh);
+	if (!error)
+		error = cb_dolrel_map(rel, rel_size, engine_size, &map);
+	if (error)
+		return error;
+	if (map.entry_point != dh->entry_point ||
+	    map.bss_start != dh->address_bss ||
+	    map.bss_end - map.bss_start != dh->size_bss)
+		return CB_EFORMAT;
+
+	/* the apploader part */
+	memset(mem, DOLREL_PAD, CB_MEM1_SIZE);
+	for (i = 0; i < DOL_MAX_SECT; i++) {
+		len = dol_sect_size(rh, i);
+		if (!len)
+			continue;
+		if (!in_mem1(dol_sect_address(rh, i), len))
+			return CB_EFORMAT;
+		memcpy(mem + dol_sect_address(rh, i) - MEM1_START,
+		       rel + dol_sect_offset(rh, i), len);
+	}
+
+	/* the engine sets up its stack over whatever was there */
+	memset(mem + map.stack_start - MEM1_START, DOLREL_STACK_FILL,
+	       map.stack_end - map.stack_start);
+
+	/* the engine part, with the plan read before it might get lost */
+	for (i = 0; i < map.nr_steps; i++) {
+		step = &map.steps[i];
+		if (!in_mem1(step->dst, step->length))
+			return CB_EFORMAT;
+		if (step->flags & DOLREL_SECTION_ZERO) {
+			memset(mem + step->dst - MEM1_START, 0, step->length);
+			continue;
+		}
+		if (!in_mem1(step->src, step->packed_length))
+			return CB_EFORMAT;
+
+		if (step->packed_length == step->length) {
+			memmove(mem + step->dst - MEM1_START,
+				mem + step->src - MEM1_START, step->length);
+		} else {
+			if (overlaps(step->dst, step->length, step->src,
+				     step->packed_length) ||
+			    lz_decompress(mem + step->dst - MEM1_START,
+					  step->length,
+					  mem + step->src - MEM1_START,
+					  step->packed_length))
+				return CB_EFORMAT;
+		}
+	}
+	if (dh->size_bss) {
+		if (!in_mem1(dh->address_bss, dh->size_bss))
+			return CB_EFORMAT;
+		memset(mem + dh->address_bss - MEM1_START, 0, dh->size_bss);
+	}
+
+	/* the engine and its stack must still be there */
+	if (memcmp(mem + map.engine_start - MEM1_START,
+		   rel + dol_sect_offset(rh, 1), engine_size))
+		return CB_EOVERLAP;
+	for (address = map.stack_start; address < map.stack_end; address++) {
+		if (mem[address - MEM1_START] != DOLREL_STACK_FILL)
+			return CB_EOVERLAP;
+	}
+
+	for (i = 0; i < DOL_MAX_SECT; i++) {
+		len = dol_sect_size(dh, i);
+		if (len && memcmp(mem + dol_sect_address(dh, i) - MEM1_START,
+				  dol + dol_sect_offset(dh, i), len))
+			return CB_EFORMAT;
+	}
+	return CB_OK;
+}
@@ -0,0 +1,44 @@
+/**
+ * error.c
+ *
+ * libcubeboot error codes.
+ * This program is part of the cubeboot-tools package.
+ *
+ * Copyright (C) 2005-2006 The GameCube Linux Team
+ * Copyright (C) 2005,2006 Albert Herranz
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ */
+
+#include "../include/cubeboot.h"
+
+/*
+ *
+ */
+const char *cb_strerror(int error)
+{
+	switch (error) {
+	case CB_OK:
+		return "success";
+	case CB_EINVAL:
+		return "invalid argument";
+	case CB_ENOSPC:
+		return "output buffer too small";
+	case CB_EOVERFLOW:
+		return "system area overflowed";
+	case CB_EFORMAT:
+		return "malformed input";
+	case CB_EVERSION:
+		return "relocation engine version mismatch";
+	case CB_EOVERLAP:
+		return "sections overlap the relocation engine or its stack";
+	case CB_ENOROOM:
+		return "no room to move sections out of the way";
+	default:
+		return "unknown error";
+	}
+}
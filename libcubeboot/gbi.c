@@ -0,0 +1,253 @@
+/**
+ * gbi.c
+ *
+ * Generic Boot Image builder.
+ * This program is part of the cubeboot-tools package.
+ *
+ * Copyright (C) 2005-2006 The GameCube Linux Team
+ * Copyright (C) 2005,2006 Albert Herranz
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/lib.h"
+#include "../include/cubeboot.h"
+
+/*
+ *
+ */
+static void default_disk_header(struct gcm_disk_header *dh)
+{
+	memset(dh, 0, sizeof(*dh));
+
+	memcpy(dh->info.game_code, "GBLP", 4);	/*Gamecube BootLoader PAL */
+	memcpy(dh->info.maker_code, "GL", 2);	/* gc-linux */
+	dh->info.magic = cpu_to_be32(0xc2339f3d);
+
+	strcpy(dh->game_name, "GAMECUBE \"EL TORITO\" BOOTLOADER");
+
+//      dh->debug_monitor_offset = cpu_to_be32(0x0001a7f4);
+//      dh->debug_monitor_address = cpu_to_be32(0x80280060);
+//      dh->layout.user_offset = cpu_to_be32(0x803ff900);
+	dh->layout.user_size = cpu_to_be32(4*1024*1024); /* 4MB */
+
+	dh->layout.disk_size = cpu_to_be32(0x56fe8000);	/* 1.4GB */
+}
+
+/*
+ *
+ */
+static void default_disk_header_info(struct gcm_disk_header_info *dhi)
+{
+	memset(dhi, 0, sizeof(*dhi));
+
+	dhi->simulated_memory_size = cpu_to_be32(0x01800000);
+	dhi->country_code = cpu_to_be32(3); /* 1=ntsc, 2=pal, 3=all */
+	dhi->unknown_1 = cpu_to_be32(1);
+}
+
+/*
+ *
+ */
+static void default_apploader_header(struct gcm_apploader_header *ah)
+{
+	memset(ah, 0, sizeof(*ah));
+
+	memcpy(ah->date, "2025/08/07", 10);
+	ah->entry_point = 0x81200000;	/* gets proper endianness later */
+}
+
+/*
+ *
+ */
+void cb_gbi_defaults(struct gcm_system_area *sa)
+{
+	memset(sa, 0, sizeof(*sa));
+
+	default_disk_header(&sa->dh);
+	default_disk_header_info(&sa->dhi);
+	default_apploader_header(&sa->al_header);
+}
+
+/*
+ * Sets a disc header field by name, as found in mkgbi manifests.
+ * Returns CB_EINVAL for unknown fields and CB_EFORMAT for bad values.
+ */
+int cb_gbi_set(struct gcm_system_area *sa, const char *key,
+	       const char *value)
+{
+	struct gcm_disk_header *dh = &sa->dh;
+	unsigned long number;
+	char *end;
+
+	if (!strcmp(key, "game_code")) {
+		if (strlen(value) != sizeof(dh->info.game_code))
+			return CB_EFORMAT;
+		memcpy(dh->info.game_code, value, sizeof(dh->info.game_code));
+	} else if (!strcmp(key, "maker_code")) {
+		if (strlen(value) != sizeof(dh->info.maker_code))
+			return CB_EFORMAT;
+		memcpy(dh->info.maker_code, value,
+		       sizeof(dh->info.maker_code));
+	} else if (!strcmp(key, "game_name")) {
+		if (strlen(value) >= sizeof(dh->game_name))
+			return CB_EFORMAT;
+		memset(dh->game_name, 0, sizeof(dh->game_name));
+		strcpy(dh->game_name, value);
+	} else if (!strcmp(key, "country_code")) {
+		number = strtoul(value, &end, 0);
+		if (!*value || *end)
+			return CB_EFORMAT;
+		sa->dhi.country_code = cpu_to_be32(number);
+	} else if (!strcmp(key, "disk_size")) {
+		number = strtoul(value, &end, 0);
+		if (!*value || *end || number > 0xffffffffUL)
+			return CB_EFORMAT;
+		dh->layout.disk_size = cpu_to_be32(number);
+	} else {
+		return CB_EINVAL;
+	}
+	return CB_OK;
+}
+
+/*
+ * Checks that everything fits in the system area.
+ */
+int cb_gbi_check(const struct gcm_system_area *sa)
+{
+	if (sizeof(sa->dh) + 0x2000 + sizeof(sa->al_header) +
+	    di_align_size(sa->al_size) + di_align_size(sa->fst_size) +
+	    di_align_size(sa->bnr_size) > SYSTEM_AREA_SIZE)
+		return CB_EOVERFLOW;
+	return CB_OK;
+}
+
+/*
+ * Location of the banner, the last thing in the system area.
+ */
+uint32_t cb_gbi_banner_offset(const struct gcm_system_area *sa)
+{
+	uint32_t offset;
+
+	offset = sizeof(sa->dh) + 0x2000 + sizeof(sa->al_header) +
+	    di_align_size(sa->al_size);
+	if (sa->fst_image)
+		offset += di_align_size(sa->fst_size);
+	return offset;
+}
+
+/*
+ *
+ */
+static void fixup_file_offsets(struct gcm_file_entry *fe, unsigned int num,
+			       unsigned long offset)
+{
+	for (; num > 0; num--, fe++)
+		fe->file.file_offset =
+		    cpu_to_be32(be32_to_cpu(fe->file.file_offset) + offset);
+}
+
+/*
+ * Assembles the system area in buf, which must hold SYSTEM_AREA_SIZE
+ * bytes.
+ * The fst follows the apploader, unless the caller placed it somewhere
+ * else on the disc (no fst_image). In that case, the fst location comes
+ * in host order in the disc header.
+ */
+int cb_gbi_build(const struct gcm_system_area *sa, void *buf, size_t size)
+{
+	struct gcm_disk_header *dh;
+	struct gcm_apploader_header *ah;
+	uint32_t fst_offset, fst_size, fst_max_size;
+	char *p = buf;
+	int error;
+
+	if (size < SYSTEM_AREA_SIZE)
+		return CB_ENOSPC;
+	error = cb_gbi_check(sa);
+	if (error)
+		return error;
+
+	if (sa->fst_image) {
+		fst_offset = cb_gbi_banner_offset(sa) -
+		    di_align_size(sa->fst_size);
+		fst_size = fst_max_size = sa->fst_size;
+	} else {
+		fst_offset = sa->dh.layout.fst_offset;
+		fst_size = sa->dh.layout.fst_size;
+		fst_max_size = sa->dh.layout.fst_max_size;
+	}
+
+	memset(p, 0, SYSTEM_AREA_SIZE);
+
+	/* disc header */
+	dh = (struct gcm_disk_header *)p;
+	memcpy(dh, &sa->dh, sizeof(*dh));
+	dh->layout.fst_offset = cpu_to_be32(fst_offset);
+	dh->layout.fst_size = cpu_to_be32(fst_size);
+	dh->layout.fst_max_size = cpu_to_be32(fst_max_size);
+	p += sizeof(*dh);
+
+	/* disc header information, with padding */
+	memcpy(p, &sa->dhi, sizeof(sa->dhi));
+	p += 0x2000;
+
+	/* apploader */
+	ah = (struct gcm_apploader_header *)p;
+	memcpy(ah, &sa->al_header, sizeof(*ah));
+	ah->entry_point = cpu_to_be32(sa->al_header.entry_point);
+	ah->size = cpu_to_be32(sa->al_size);
+	p += sizeof(*ah);
+	memcpy(p, sa->al_image, sa->al_size);
+	p += di_align_size(sa->al_size);
+
+	/* fst, whose only file is the banner right after it */
+	if (sa->fst_image) {
+		memcpy(p, sa->fst_image, sa->fst_size);
+		fixup_file_offsets((struct gcm_file_entry *)p + 1, 1,
+				   fst_offset + di_align_size(sa->fst_size));
+		p += di_align_size(sa->fst_size);
+	}
+
+	/* opening.bnr */
+	memcpy(p, sa->bnr_image, sa->bnr_size);
+
+	return CB_OK;
+}
+
+/*
+ * Builds a fst describing a single file, whose offset needs to be fixed
+ * afterwards (cb_gbi_build does so).
+ */
+int cb_fst_single_file(const char *fname, uint32_t flen, void *buf,
+		       size_t size, size_t *fst_size)
+{
+	struct gcm_file_entry *fe = buf;
+	size_t file_entry_table_size = 2 * sizeof(struct gcm_file_entry);
+	size_t string_table_size = strlen(fname) + 1;
+
+	*fst_size = file_entry_table_size + string_table_size;
+	if (size < *fst_size)
+		return CB_ENOSPC;
+
+	/* zero out values */
+	memset(buf, 0, *fst_size);
+
+	/* root directory */
+	fe[0].flags = 1;	/* directory */
+	fe[0].root_dir.num_entries = cpu_to_be32(2);
+
+	fe[1].file.fname_offset = 0;	/* in string table */
+	fe[1].file.file_offset = 0;	/* needs fixup afterwards */
+	fe[1].file.file_length = cpu_to_be32(flen);
+	strcpy((char *)buf + file_entry_table_size, fname);
+
+	return CB_OK;
+}
@@ -0,0 +1,86 @@
+/**
+ * gcm.c
+ *
+ * Nintendo GameCube Master file parser.
+ * This program is part of the cubeboot-tools package.
+ *
+ * Copyright (C) 2005-2006 The GameCube Linux Team
+ * Copyright (C) 2005,2006 Albert Herranz
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ */
+
+#include <string.h>
+
+#include "../include/lib.h"
+#include "../include/cubeboot.h"
+
+#define GCM_APPLOADER_OFFSET	0x2440
+
+/*
+ * Copies the disc headers out of an image, as they are on disc.
+ * The magic number is not checked, that's up to the caller.
+ */
+int cb_gcm_parse(const void *image, size_t size, struct cb_gcm_info *info)
+{
+	if (size < GCM_APPLOADER_OFFSET + sizeof(info->ah))
+		return CB_EFORMAT;
+
+	memcpy(&info->dh, image, sizeof(info->dh));
+	memcpy(&info->dhi, image + sizeof(info->dh), sizeof(info->dhi));
+	memcpy(&info->ah, image + GCM_APPLOADER_OFFSET, sizeof(info->ah));
+	return CB_OK;
+}
+
+/*
+ * Locates the fst of an image, checking that it fits there.
+ */
+int cb_gcm_fst(const void *image, size_t size,
+	       const struct gcm_disk_header *dh, struct cb_gcm_fst *fst)
+{
+	const struct gcm_file_entry *fe;
+	uint32_t fst_offset, fst_size;
+	size_t table_size;
+
+	fst_offset = be32_to_cpu(dh->layout.fst_offset);
+	fst_size = be32_to_cpu(dh->layout.fst_size);
+	if (fst_offset > size || fst_size > size - fst_offset ||
+	    fst_size < sizeof(*fe))
+		return CB_EFORMAT;
+
+	fe = image + fst_offset;
+	fst->nr_entries = be32_to_cpu(fe->root_dir.num_entries);
+	if (fst->nr_entries == 0 ||
+	    fst->nr_entries > fst_size / sizeof(*fe))
+		return CB_EFORMAT;
+
+	table_size = fst->nr_entries * sizeof(*fe);
+	fst->entries = fe;
+	fst->string_table = (const char *)fe + table_size;
+	fst->string_table_size = fst_size - table_size;
+	return CB_OK;
+}
+
+/*
+ * Returns the name of a fst entry, or NULL if it is not in the string
+ * table.
+ */
+const char *cb_gcm_entry_name(const struct cb_gcm_fst *fst,
+			      const struct gcm_file_entry *fe)
+{
+	uint32_t fname_offset;
+	const char *name;
+
+	fname_offset = be32_to_cpu(fe->file.fname_offset) & 0x00ffffff;
+	if (fname_offset >= fst->string_table_size)
+		return NULL;
+
+	name = fst->string_table + fname_offset;
+	if (!memchr(name, '\0', fst->string_table_size - fname_offset))
+		return NULL;
+	return name;
+}
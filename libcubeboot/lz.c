@@ -0,0 +1,145 @@
+/**
+ * lz.c
+ *
+ * LZ compressor for relocated DOL sections (see lz.h for the format).
+ * This program is part of the cubeboot-tools package.
+ *
+ * Copyright (C) 2005-2006 The GameCube Linux Team
+ * Copyright (C) 2005,2006 Albert Herranz
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ */
+
+/*
+ * A greedy single pass compressor: matches are found through a small
+ * hash table of the last positions where each 4 byte string was seen.
+ * It favours speed, as does the format, over the last bit of ratio.
+ */
+
+#include <string.h>
+
+#include "../include/lz.h"
+
+#define LZ_HASH_BITS	14
+
+/*
+ *
+ */
+static inline uint32_t lz_hash(const unsigned char *p)
+{
+	uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+
+	return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+/*
+ * Writes the extra bytes of a length which didn't fit in its nibble.
+ */
+static unsigned char *lz_put_length(unsigned char *op, unsigned char *oend,
+				    size_t len)
+{
+	while (len >= 255) {
+		if (op == oend)
+			return NULL;
+		*op++ = 255;
+		len -= 255;
+	}
+	if (op == oend)
+		return NULL;
+	*op++ = len;
+	return op;
+}
+
+/*
+ * Writes a sequence. A match_len of 0 makes it the last one.
+ */
+static unsigned char *lz_put_sequence(unsigned char *op, unsigned char *oend,
+				      const unsigned char *literals,
+				      size_t nr_literals, uint32_t offset,
+				      size_t match_len)
+{
+	unsigned int token;
+
+	if (match_len)
+		match_len -= LZ_MIN_MATCH;
+
+	token = (nr_literals < 15) ? nr_literals << 4 : 15 << 4;
+	if (offset)
+		token |= (match_len < 15) ? match_len : 15;
+
+	if (op == oend)
+		return NULL;
+	*op++ = token;
+	if (nr_literals >= 15) {
+		op = lz_put_length(op, oend, nr_literals - 15);
+		if (!op)
+			return NULL;
+	}
+	if (nr_literals > oend - op)
+		return NULL;
+	memcpy(op, literals, nr_literals);
+	op += nr_literals;
+
+	if (!offset)
+		return op;
+	if (oend - op < 2)
+		return NULL;
+	*op++ = offset >> 8;
+	*op++ = offset;
+	if (match_len >= 15)
+		op = lz_put_length(op, oend, match_len - 15);
+	return op;
+}
+
+/*
+ * Compresses len bytes of src into dst.
+ * Returns the compressed size, or 0 if it doesn't fit in dst_size bytes.
+ */
+size_t lz_compress(const unsigned char *src, size_t len,
+		   unsigned char *dst, size_t dst_size)
+{
+	uint32_t table[1 << LZ_HASH_BITS];
+	const unsigned char *ip = src, *anchor = src, *end = src + len;
+	const unsigned char *match;
+	unsigned char *op = dst, *oend = dst + dst_size;
+	size_t match_len;
+	uint32_t h;
+
+	/* stale entries are harmless, every candidate gets checked */
+	memset(table, 0, sizeof(table));
+
+	while (end - ip >= LZ_MIN_MATCH) {
+		h = lz_hash(ip);
+		match = src + table[h];
+		table[h] = ip - src;
+		if (match >= ip || ip - match > LZ_MAX_OFFSET ||
+		    memcmp(match, ip, LZ_MIN_MATCH)) {
+			ip++;
+			continue;
+		}
+
+		match_len = LZ_MIN_MATCH;
+		while (ip + match_len < end && match[match_len] == ip[match_len])
+			match_len++;
+
+		op = lz_put_sequence(op, oend, anchor, ip - anchor, ip - match,
+				     match_len);
+		if (!op)
+			return 0;
+
+		ip += match_len;
+		anchor = ip;
+		/* let the next match start inside this one */
+		if (end - ip >= LZ_MIN_MATCH + 2)
+			table[lz_hash(ip - 2)] = ip - 2 - src;
+	}
+
+	op = lz_put_sequence(op, oend, anchor, end - anchor, 0, 0);
+	if (!op)
+		return 0;
+	return op - dst;
+}
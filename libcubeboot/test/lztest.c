@@ -0,0 +1,327 @@
+/*
+ * lztest.c
+ *
+ * Tests the LZ compressor of libcubeboot and the decoder in lz.h, which
+ * is the one the relocation engine runs.
+ * This program is part of the cubeboot-tools package.
+ *
+ * Every input is compressed and decompressed back, and damaged streams
+ * are fed to the decoder, which must refuse them without writing past
+ * the end of its output.
+ *
+ * Copyright (C) 2005-2006 The GameCube Linux Team
+ * Copyright (C) 2005,2006 Albert Herranz
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../../include/lz.h"
+
+/* bytes checked after each output buffer for stray writes */
+#define GUARD		64
+#define GUARD_BYTE	0xa5
+
+/* worst case growth of incompressible data, see lz_put_sequence() */
+#define LZ_BOUND(len)	((len) + (len) / 255 + 16)
+
+static int failures;
+
+#define expect(cond, what) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "FAIL %s: %s\n", what, #cond); \
+			failures++; \
+		} \
+	} while (0)
+
+/*
+ *
+ */
+static void *xmalloc(size_t size)
+{
+	void *p = malloc(size ? size : 1);
+
+	if (!p) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	return p;
+}
+
+/*
+ * A repeatable pseudo random sequence, so failures can be reproduced.
+ */
+static uint32_t rand_state = 1;
+
+static unsigned char next_random(void)
+{
+	rand_state = rand_state * 1103515245 + 12345;
+	return rand_state >> 16;
+}
+
+/*
+ * Decompresses into a buffer with a guard area behind it.
+ * Returns what lz_decompress() does, and checks the guard.
+ */
+static int decompress(const char *what, unsigned char *dst, uint32_t dst_len,
+		      const unsigned char *src, uint32_t src_len)
+{
+	int result, i;
+
+	memset(dst + dst_len, GUARD_BYTE, GUARD);
+	result = lz_decompress(dst, dst_len, src, src_len);
+	for (i = 0; i < GUARD; i++) {
+		if (dst[dst_len + i] != GUARD_BYTE) {
+			fprintf(stderr, "FAIL %s: wrote past the output, "
+				"at +%d\n", what, i);
+			failures++;
+			break;
+		}
+	}
+	return result;
+}
+
+/*
+ * Compresses and decompresses data, checking we get it back.
+ * The stream is also handed to the damage tests.
+ */
+static void round_trip(const char *what, const unsigned char *data,
+		       size_t len, size_t max_packed);
+
+static void damage(const char *what, const unsigned char *data, size_t len,
+		   const unsigned char *packed, size_t packed_len);
+
+static void round_trip(const char *what, const unsigned char *data,
+		       size_t len, size_t max_packed)
+{
+	unsigned char *packed, *out;
+	size_t packed_len;
+
+	packed = xmalloc(LZ_BOUND(len));
+	out = xmalloc(len + GUARD);
+
+	packed_len = lz_compress(data, len, packed, LZ_BOUND(len));
+	expect(packed_len > 0, what);
+	expect(packed_len <= max_packed, what);
+	if (packed_len > 0) {
+		expect(decompress(what, out, len, packed, packed_len) == 0,
+		       what);
+		expect(!memcmp(out, data, len), what);
+
+		/* the compressor must notice when it runs out of room */
+		expect(lz_compress(data, len, packed, packed_len - 1) == 0,
+		       what);
+		packed_len = lz_compress(data, len, packed, LZ_BOUND(len));
+
+		damage(what, data, len, packed, packed_len);
+	}
+
+	free(out);
+	free(packed);
+}
+
+/*
+ * Truncated and corrupted streams, and wrong output sizes.
+ */
+static void damage(const char *what, const unsigned char *data, size_t len,
+		   const unsigned char *packed, size_t packed_len)
+{
+	unsigned char *bad, *out;
+	size_t i, step;
+	int bit, result;
+
+	bad = xmalloc(packed_len);
+	out = xmalloc(len + 1 + GUARD);
+
+	/*
+	 * Every truncation must be refused, except dropping the empty
+	 * sequence which ends a stream after a match, which loses nothing.
+	 */
+	step = packed_len > 4096 ? packed_len / 512 : 1;
+	for (i = 0; i < packed_len; i += step) {
+		result = decompress(what, out, len, packed, i);
+		expect(result == -1 || (i == packed_len - 1 &&
+					packed[i] == 0 && result == 0 &&
+					!memcmp(out, data, len)),
+		       "truncated stream");
+	}
+
+	/* wrong output sizes */
+	if (len > 0)
+		expect(decompress(what, out, len - 1, packed, packed_len) == -1,
+		       "output too small");
+	expect(decompress(what, out, len + 1, packed, packed_len) == -1,
+	       "output too big");
+
+	/* flipped bits may decode to garbage, but never out of bounds */
+	for (i = 0; i < packed_len; i += step) {
+		for (bit = 0; bit < 8; bit++) {
+			memcpy(bad, packed, packed_len);
+			bad[i] ^= 1 << bit;
+			decompress("corrupt stream", out, len, bad, packed_len);
+		}
+	}
+
+	/* and so may random garbage */
+	for (i = 0; i < packed_len; i++)
+		bad[i] = next_random();
+	decompress("random stream", out, len, bad, packed_len);
+
+	free(out);
+	free(bad);
+}
+
+/*
+ *
+ */
+static void test_edges(void)
+{
+	static const unsigned char one[] = { 0x42 };
+	static const unsigned char four[] = { 1, 2, 3, 4 };
+	static const unsigned char nine[] = { 7, 7, 7, 7, 7, 7, 7, 7, 7 };
+
+	round_trip("empty", one, 0, 1);
+	round_trip("one byte", one, 1, 2);
+	round_trip("min match length", four, 4, 5);
+	round_trip("short run", nine, 9, 9);
+}
+
+/*
+ * Runs and short periods, where the match overlaps its own output.
+ */
+static void test_overlapping(void)
+{
+	static const size_t periods[] = { 1, 2, 3, 4, 7, 31, 32, 33 };
+	static const size_t lengths[] = { 5, 19, 20, 270, 4096, 70000 };
+	unsigned char *data;
+	size_t p, l, i;
+	char what[64];
+
+	data = xmalloc(70000);
+	for (p = 0; p < sizeof(periods) / sizeof(periods[0]); p++) {
+		for (l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+			if (lengths[l] <= periods[p])
+				continue;
+			for (i = 0; i < lengths[l]; i++)
+				data[i] = (i % periods[p]) * 37 + 1;
+			snprintf(what, sizeof(what), "period %lu, %lu bytes",
+				 (unsigned long)periods[p],
+				 (unsigned long)lengths[l]);
+			round_trip(what, data, lengths[l],
+				   periods[p] + lengths[l] / 200 + 8);
+		}
+	}
+	free(data);
+}
+
+/*
+ *
+ */
+static void test_incompressible(void)
+{
+	static const size_t lengths[] = { 2, 3, 15, 16, 269, 270, 65536 };
+	unsigned char *data;
+	size_t l, i;
+	char what[64];
+
+	data = xmalloc(65536);
+	for (l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+		for (i = 0; i < lengths[l]; i++)
+			data[i] = next_random();
+		snprintf(what, sizeof(what), "random, %lu bytes",
+			 (unsigned long)lengths[l]);
+		round_trip(what, data, lengths[l], LZ_BOUND(lengths[l]));
+	}
+	free(data);
+}
+
+/*
+ * Long matches, and repeats too far away to be matched.
+ */
+static void test_long_matches(void)
+{
+	size_t len = 3 * 40000, i;
+	unsigned char *data;
+
+	data = xmalloc(len);
+
+	/* a random block followed by two copies of it */
+	for (i = 0; i < 40000; i++)
+		data[i] = next_random();
+	memcpy(data + 40000, data, 40000);
+	memcpy(data + 80000, data, 40000);
+	round_trip("repeated block", data, len, 40000 + len / 200 + 64);
+
+	/* a random block repeated beyond LZ_MAX_OFFSET */
+	len = 2 * (LZ_MAX_OFFSET + 100);
+	data = realloc(data, len);
+	for (i = 0; i < len / 2; i++)
+		data[i] = next_random();
+	memcpy(data + len / 2, data, len / 2);
+	round_trip("repeat out of reach", data, len, LZ_BOUND(len));
+
+	free(data);
+}
+
+/*
+ * Hand made streams with one thing wrong each.
+ */
+static void test_malformed(void)
+{
+	static const struct {
+		const char *what;
+		unsigned char stream[8];
+		uint32_t stream_len;
+		uint32_t dst_len;
+	} cases[] = {
+		{ "zero offset", { 0x10, 'a', 0x00, 0x00 }, 4, 5 },
+		{ "offset before the output", { 0x10, 'a', 0x00, 0x02 }, 4, 5 },
+		{ "match past the output", { 0x10, 'a', 0x00, 0x01 }, 4, 4 },
+		{ "literals past the output", { 0x30, 'a', 'b', 'c' }, 4, 2 },
+		{ "literals past the stream", { 0x30, 'a', 'b' }, 3, 3 },
+		{ "cut literal length", { 0xf0, 0xff }, 2, 300 },
+		{ "cut offset", { 0x10, 'a', 0x00 }, 3, 5 },
+		{ "cut match length", { 0x1f, 'a', 0x00, 0x01, 0xff }, 5, 300 },
+		{ "garbage after the end",
+		  { 0x10, 'a', 0x00, 0x01, 0x10, 'b' }, 6, 5 },
+	};
+	unsigned char out[512 + GUARD];
+	int i;
+
+	for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+		expect(decompress(cases[i].what, out, cases[i].dst_len,
+				  cases[i].stream, cases[i].stream_len) == -1,
+		       cases[i].what);
+
+	/* and one right, to be sure the cases above fail for their reason */
+	{
+		static const unsigned char good[] = { 0x10, 'a', 0x00, 0x01 };
+
+		expect(decompress("good", out, 5, good, sizeof(good)) == 0 &&
+		       !memcmp(out, "aaaaa", 5), "good stream");
+	}
+}
+
+int main(void)
+{
+	test_edges();
+	test_overlapping();
+	test_incompressible();
+	test_long_matches();
+	test_malformed();
+
+	if (failures) {
+		fprintf(stderr, "%d failures\n", failures);
+		return 1;
+	}
+	printf("lz: all tests passed\n");
+	return 0;
+}
@@ -0,0 +1,31 @@
+/**
+ * version.c
+ *
+ * libcubeboot build id.
+ * This program is part of the cubeboot-tools package.
+ *
+ * Copyright (C) 2005-2006 The GameCube Linux Team
+ * Copyright (C) 2005,2006 Albert Herranz
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ */
+
+#include "../include/cubeboot.h"
+
+#ifndef CB_BUILD_ID
+#define CB_BUILD_ID "unknown"
+#endif
+
+/*
+ * A hash of the library sources, set by the Makefile.
+ * It changes with any change to the code, so results kept across builds
+ * (see common/cache.c) can be told apart.
+ */
+const char *cb_build_id(void)
+{
+	return CB_BUILD_ID;
+}
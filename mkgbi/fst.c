@@ -0,0 +1,562 @@
+/**
+ * fst.c
+ *
+ * GameCube file system table builder.
+ * This program is part of the cubeboot-tools package.
+ *
+ * Builds a FST describing a directory tree, with each file pointing to
+ * the place where an iso9660 image of that same tree holds its data.
+ *
+ * Copyright (C) 2005-2006 The GameCube Linux Team
+ * Copyright (C) 2005,2006 Albert Herranz
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <strings.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../include/lib.h"
+#include "../include/gcm.h"
+#include "../include/iso9660.h"
+#include "../include/fst.h"
+
+/* file name offsets share their word with the entry flags */
+#define FST_MAX_STRING_TABLE_SIZE	(1 << 24)
+
+/*
+ * Directories waiting to be scanned.
+ */
+struct scan_queue {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct fst_node **dirs;
+	unsigned int nr_dirs;
+	unsigned int max_dirs;
+	unsigned int pending;	/* queued or being scanned */
+};
+
+/*
+ *
+ */
+static struct fst_node *fst_new_node(struct fst_node *parent, const char *name)
+{
+	struct fst_node *node;
+
+	node = xmalloc(sizeof(*node));
+	memset(node, 0, sizeof(*node));
+	node->parent = parent;
+	node->name = strdup(name);
+	if (!node->name)
+		die("not enough memory for fst\n");
+	return node;
+}
+
+/*
+ *
+ */
+static int fst_compare_nodes(const void *a, const void *b)
+{
+	const struct fst_node *na = *(const struct fst_node **)a;
+	const struct fst_node *nb = *(const struct fst_node **)b;
+
+	return strcmp(na->name, nb->name);
+}
+
+/*
+ *
+ */
+static void fst_add_child(struct fst_node *dir, struct fst_node *node,
+			  unsigned int *max_children)
+{
+	if (dir->nr_children == *max_children) {
+		*max_children = *max_children ? *max_children * 2 : 16;
+		dir->children = xrealloc(dir->children,
+					 *max_children * sizeof(node));
+	}
+	dir->children[dir->nr_children++] = node;
+}
+
+/*
+ * Reads the entries of a directory, and the sizes of its files.
+ * Anything which is not a regular file or a directory is left out.
+ */
+static void fst_scan_dir(struct fst_node *dir)
+{
+	struct fst_node *node;
+	struct dirent *de;
+	struct stat st;
+	unsigned int max_children = 0;
+	size_t path_len;
+	DIR *d;
+
+	d = opendir(dir->path);
+	if (!d)
+		die("%s: can't open directory: %s\n", dir->path,
+		    strerror(errno));
+
+	path_len = strlen(dir->path);
+	while ((de = readdir(d)) != NULL) {
+		if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+			continue;
+
+		if (fstatat(dirfd(d), de->d_name, &st,
+			    AT_SYMLINK_NOFOLLOW) < 0)
+			die("%s/%s: can't stat: %s\n", dir->path, de->d_name,
+			    strerror(errno));
+		if (!S_ISREG(st.st_mode) && !S_ISDIR(st.st_mode)) {
+			fprintf(stderr, "%s/%s: not a file, skipped\n",
+				dir->path, de->d_name);
+			continue;
+		}
+
+		node = fst_new_node(dir, de->d_name);
+		if (S_ISDIR(st.st_mode)) {
+			node->is_dir = 1;
+			node->path = xmalloc(path_len + strlen(de->d_name) + 2);
+			sprintf(node->path, "%s/%s", dir->path, de->d_name);
+		} else {
+			if (st.st_size > 0xffffffffLL)
+				die("%s/%s: file too large for a fst\n",
+				    dir->path, de->d_name);
+			node->size = st.st_size;
+		}
+		fst_add_child(dir, node, &max_children);
+	}
+	closedir(d);
+
+	qsort(dir->children, dir->nr_children, sizeof(*dir->children),
+	      fst_compare_nodes);
+}
+
+/*
+ * Scanning thread.
+ * Takes directories from the queue and feeds back their subdirectories
+ * until no directory is left to scan.
+ */
+static void *fst_scan_thread(void *arg)
+{
+	struct scan_queue *q = arg;
+	struct fst_node *dir;
+	unsigned int i;
+
+	pthread_mutex_lock(&q->lock);
+	for (;;) {
+		while (!q->nr_dirs && q->pending)
+			pthread_cond_wait(&q->cond, &q->lock);
+		if (!q->nr_dirs)
+			break;
+		dir = q->dirs[--q->nr_dirs];
+		pthread_mutex_unlock(&q->lock);
+
+		fst_scan_dir(dir);
+
+		pthread_mutex_lock(&q->lock);
+		for (i = 0; i < dir->nr_children; i++) {
+			if (!dir->children[i]->is_dir)
+				continue;
+			if (q->nr_dirs == q->max_dirs) {
+				q->max_dirs *= 2;
+				q->dirs = xrealloc(q->dirs, q->max_dirs *
+						   sizeof(*q->dirs));
+			}
+			q->dirs[q->nr_dirs++] = dir->children[i];
+			q->pending++;
+		}
+		q->pending--;
+		pthread_cond_broadcast(&q->cond);
+	}
+	pthread_mutex_unlock(&q->lock);
+
+	return NULL;
+}
+
+/*
+ * Reads a directory tree using nr_threads scanning threads.
+ */
+struct fst_node *fst_scan_tree(const char *root, int nr_threads)
+{
+	struct fst_node *root_node;
+	struct scan_queue q;
+	pthread_t *threads;
+	int i, result;
+
+	root_node = fst_new_node(NULL, "");
+	root_node->is_dir = 1;
+	root_node->path = strdup(root);
+	if (!root_node->path)
+		die("not enough memory for fst\n");
+
+	if (nr_threads < 1)
+		nr_threads = 1;
+
+	pthread_mutex_init(&q.lock, NULL);
+	pthread_cond_init(&q.cond, NULL);
+	q.max_dirs = 64;
+	q.dirs = xmalloc(q.max_dirs * sizeof(*q.dirs));
+	q.dirs[0] = root_node;
+	q.nr_dirs = 1;
+	q.pending = 1;
+
+	threads = xmalloc(nr_threads * sizeof(*threads));
+	for (i = 0; i < nr_threads; i++) {
+		result = pthread_create(&threads[i], NULL, fst_scan_thread, &q);
+		if (result)
+			die("can't create scanning thread: %s\n",
+			    strerror(result));
+	}
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+	free(q.dirs);
+	pthread_cond_destroy(&q.cond);
+	pthread_mutex_destroy(&q.lock);
+
+	return root_node;
+}
+
+/*
+ *
+ */
+void fst_free_tree(struct fst_node *node)
+{
+	unsigned int i;
+
+	for (i = 0; i < node->nr_children; i++)
+		fst_free_tree(node->children[i]);
+	free(node->children);
+	free(node->path);
+	free(node->name);
+	free(node);
+}
+
+/*
+ * Adds a file which lives outside the scanned tree, like the banner.
+ */
+struct fst_node *fst_add_file(struct fst_node *dir, const char *name,
+			      off_t size, uint32_t disk_offset)
+{
+	struct fst_node *node;
+	unsigned int max_children = dir->nr_children;
+
+	node = fst_new_node(dir, name);
+	node->size = size;
+	node->disk_offset = disk_offset;
+	node->located = 1;
+
+	/* force a reallocation */
+	fst_add_child(dir, node, &max_children);
+	qsort(dir->children, dir->nr_children, sizeof(*dir->children),
+	      fst_compare_nodes);
+
+	return node;
+}
+
+/*
+ * Returns the host path of a scanned file or directory.
+ */
+char *fst_node_path(struct fst_node *node)
+{
+	char *path;
+
+	if (node->path)
+		return strdup(node->path);
+	if (!node->parent || !node->parent->path)
+		return NULL;
+
+	path = xmalloc(strlen(node->parent->path) + strlen(node->name) + 2);
+	sprintf(path, "%s/%s", node->parent->path, node->name);
+	return path;
+}
+
+/*
+ *
+ */
+static void fst_pread(int fd, void *buf, size_t count, off_t offset)
+{
+	ssize_t result;
+	size_t progress = 0;
+
+	while (progress < count) {
+		result = pread(fd, buf + progress, count - progress,
+			       offset + progress);
+		if (result < 0) {
+			if ((errno == EINTR) || (errno == EAGAIN))
+				continue;
+			die("can't read image: %s\n", strerror(errno));
+		}
+		if (result == 0)
+			die("image truncated at offset %lld\n",
+			    (long long)(offset + progress));
+		progress += result;
+	}
+}
+
+/*
+ * Gets the Rock Ridge name of a directory record, if any.
+ */
+static int iso_rr_name(struct iso_directory_record *dr, char *buf, size_t size)
+{
+	uint8_t *su, *end;
+	size_t len = 0;
+	int found = 0;
+
+	su = (uint8_t *)dr->name + dr->name_len + !(dr->name_len & 1);
+	end = (uint8_t *)dr + dr->length;
+
+	while (su + 4 <= end && su[2] >= 4 && su + su[2] <= end) {
+		if (su[0] == 'N' && su[1] == 'M' && su[2] > 5) {
+			if (len + su[2] - 5 >= size)
+				return 0;
+			memcpy(buf + len, su + 5, su[2] - 5);
+			len += su[2] - 5;
+			found = 1;
+		}
+		su += su[2];
+	}
+	buf[len] = '\0';
+
+	return found;
+}
+
+/*
+ * Gets the plain iso9660 name of a directory record, without version.
+ */
+static void iso_name(struct iso_directory_record *dr, char *buf)
+{
+	int len = dr->name_len;
+
+	memcpy(buf, dr->name, len);
+	buf[len] = '\0';
+	while (len > 0 && buf[len - 1] != ';')
+		len--;
+	if (len > 0)
+		buf[--len] = '\0';
+	if (len > 0 && buf[len - 1] == '.')
+		buf[--len] = '\0';
+	if (!len)
+		buf[dr->name_len] = '\0';
+}
+
+/*
+ *
+ */
+static struct fst_node *fst_find_child(struct fst_node *dir, const char *name,
+				       int exact)
+{
+	struct fst_node key, *pkey = &key, **found;
+	unsigned int i;
+
+	key.name = (char *)name;
+	found = bsearch(&pkey, dir->children, dir->nr_children,
+			sizeof(*dir->children), fst_compare_nodes);
+	if (found)
+		return *found;
+
+	if (!exact) {
+		for (i = 0; i < dir->nr_children; i++) {
+			if (!strcasecmp(dir->children[i]->name, name))
+				return dir->children[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Matches the entries of an iso9660 directory with the scanned ones.
+ */
+static void fst_locate_dir(struct fst_node *dir, int image_fd,
+			   uint32_t extent, uint32_t size)
+{
+	struct iso_directory_record *dr;
+	struct fst_node *node;
+	uint8_t *buf, *p;
+	char name[256];
+	int exact;
+	unsigned int i;
+
+	buf = xmalloc(size);
+	fst_pread(image_fd, buf, size, (off_t)extent * ISO_SECTOR_SIZE);
+
+	p = buf;
+	while (p < buf + size) {
+		dr = (struct iso_directory_record *)p;
+
+		/* records never cross sector boundaries */
+		if (!dr->length) {
+			p = buf + (((p - buf) / ISO_SECTOR_SIZE) + 1) *
+			    ISO_SECTOR_SIZE;
+			continue;
+		}
+		p += dr->length;
+
+		/* skip "." and ".." */
+		if (dr->name_len == 1 && (dr->name[0] == 0 || dr->name[0] == 1))
+			continue;
+
+		exact = iso_rr_name(dr, name, sizeof(name));
+		if (!exact)
+			iso_name(dr, name);
+
+		node = fst_find_child(dir, name, exact);
+		if (!node || node->located)
+			continue;
+
+		if (node->is_dir != !!(dr->flags & ISO_FLAG_DIRECTORY))
+			continue;
+		if (dr->flags & ISO_FLAG_MULTI_EXTENT)
+			die("%s/%s: multi-extent files are not supported\n",
+			    dir->path, node->name);
+
+		node->disk_offset = iso_733(dr->extent) * ISO_SECTOR_SIZE;
+		node->located = 1;
+		if (node->is_dir) {
+			fst_locate_dir(node, image_fd, iso_733(dr->extent),
+				       iso_733(dr->size));
+		} else if (iso_733(dr->size) != node->size) {
+			die("%s/%s: size differs in image\n",
+			    dir->path, node->name);
+		}
+	}
+
+	free(buf);
+
+	for (i = 0; i < dir->nr_children; i++) {
+		if (!dir->children[i]->located)
+			die("%s/%s: not found in image"
+			    " (was it built with Rock Ridge extensions?)\n",
+			    dir->path, dir->children[i]->name);
+	}
+}
+
+/*
+ * Finds where the iso9660 image places each of the scanned files.
+ */
+void fst_locate_in_image(struct fst_node *root, int image_fd)
+{
+	struct iso_primary_descriptor pvd;
+	struct iso_directory_record *dr;
+	unsigned int sector;
+
+	for (sector = ISO_VD_SECTOR;; sector++) {
+		fst_pread(image_fd, &pvd, sizeof(pvd),
+			  (off_t)sector * ISO_SECTOR_SIZE);
+		if (memcmp(pvd.id, ISO_STANDARD_ID, sizeof(pvd.id)))
+			die("image has no iso9660 volume descriptors\n");
+		if (pvd.type == ISO_VD_PRIMARY)
+			break;
+		if (pvd.type == ISO_VD_END)
+			die("image has no iso9660 primary volume descriptor\n");
+	}
+
+	dr = (struct iso_directory_record *)pvd.root_directory_record;
+	root->disk_offset = iso_733(dr->extent) * ISO_SECTOR_SIZE;
+	root->located = 1;
+	fst_locate_dir(root, image_fd, iso_733(dr->extent), iso_733(dr->size));
+}
+
+/*
+ * Numbers the entries in the order they appear in the fst, and sizes
+ * the string table.
+ */
+static void fst_number_nodes(struct fst_node *node, uint32_t *index,
+			     size_t *string_table_size)
+{
+	unsigned int i;
+
+	node->index = (*index)++;
+	if (node->parent)
+		*string_table_size += strlen(node->name) + 1;
+
+	for (i = 0; i < node->nr_children; i++)
+		fst_number_nodes(node->children[i], index, string_table_size);
+
+	node->next_index = *index;
+}
+
+/*
+ *
+ */
+static void fst_fill_entries(struct fst_node *node, struct gcm_file_entry *fe,
+			     char *string_table, uint32_t *string_offset)
+{
+	struct gcm_file_entry *entry = &fe[node->index];
+	unsigned int i;
+
+	if (!node->parent) {
+		/* root directory */
+		entry->flags = 1;
+		entry->root_dir.num_entries = cpu_to_be32(node->next_index);
+	} else {
+		entry->file.fname_offset =
+		    cpu_to_be32((node->is_dir << 24) | *string_offset);
+		strcpy(string_table + *string_offset, node->name);
+		*string_offset += strlen(node->name) + 1;
+
+		if (node->is_dir) {
+			entry->dir.parent_directory_offset =
+			    cpu_to_be32(node->parent->index);
+			entry->dir.this_directory_offset =
+			    cpu_to_be32(node->next_index);
+		} else {
+			entry->file.file_offset =
+			    cpu_to_be32(node->disk_offset);
+			entry->file.file_length = cpu_to_be32(node->size);
+		}
+	}
+
+	for (i = 0; i < node->nr_children; i++)
+		fst_fill_entries(node->children[i], fe, string_table,
+				 string_offset);
+}
+
+/*
+ * Numbers the entries of a tree and returns the size of its fst.
+ */
+uint32_t fst_layout_size(struct fst_node *root)
+{
+	size_t string_table_size = 0;
+	uint32_t nr_entries = 0;
+
+	fst_number_nodes(root, &nr_entries, &string_table_size);
+	if (string_table_size > FST_MAX_STRING_TABLE_SIZE)
+		die("too many file names for a fst\n");
+
+	return nr_entries * sizeof(struct gcm_file_entry) + string_table_size;
+}
+
+/*
+ * Lays out the fst for a tree, file entries in depth first order followed
+ * by the string table.
+ */
+void *fst_build(struct fst_node *root, uint32_t *fst_size)
+{
+	struct gcm_file_entry *fe;
+	size_t file_entry_table_size;
+	uint32_t string_offset = 0;
+	void *fst;
+
+	*fst_size = fst_layout_size(root);
+	file_entry_table_size = root->next_index * sizeof(struct gcm_file_entry);
+
+	fst = xmalloc(*fst_size);
+	memset(fst, 0, *fst_size);
+
+	fe = fst;
+	fst_fill_entries(root, fe, fst + file_entry_table_size, &string_offset);
+
+	return fst;
+}
@@ -0,0 +1,1190 @@
+/**
+ * iso9660.c
+ *
+ * "El Torito" bootable iso9660 image writer.
+ * This program is part of the cubeboot-tools package.
+ *
+ * Writes everything following the GBI system area in a single sequential
+ * pass: volume descriptors, boot catalog, boot DOL, FST, path tables,
+ * directories with Rock Ridge names and the file extents.
+ *
+ * Everything the apploader reads is packed at the start of the disc, in
+ * the order it is read, to keep the drive from seeking around on boot.
+ *
+ * Copyright (C) 2005-2006 The GameCube Linux Team
+ * Copyright (C) 2005,2006 Albert Herranz
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../include/lib.h"
+#include "../include/gcm.h"
+#include "../include/dol.h"
+#include "../include/iso9660.h"
+#include "../include/fst.h"
+
+/* "name.ext;1" */
+#define ISO_MAX_ID_LEN		31
+
+/* the apploader only reads the start of the boot record */
+#define ELTORITO_BOOT_RECORD_READ	0x60
+
+/* sizes of the directory record and its system use entries */
+#define ISO_RECORD_SIZE		33
+#define SUSP_SP_SIZE		7
+#define SUSP_NM_SIZE		5
+#define SUSP_PX_SIZE		36
+#define RR_ER_ID		"RRIP_1991A"
+#define RR_ER_DESCRIPTOR	"ROCK RIDGE INTERCHANGE PROTOCOL"
+#define RR_ER_SOURCE		"CUBEBOOT-TOOLS"
+#define SUSP_ER_SIZE		(8 + sizeof(RR_ER_ID) - 1 + \
+				 sizeof(RR_ER_DESCRIPTOR) - 1 + \
+				 sizeof(RR_ER_SOURCE) - 1)
+
+/* everything on the disc is read only */
+#define RR_FILE_MODE		0100444
+#define RR_DIR_MODE		0040555
+
+#define ISO_VOLUME_ID		"CUBEBOOT"
+#define ISO_APPLICATION_ID	"MKGBI"
+
+struct iso_entry {
+	struct fst_node *node;
+	char id[ISO_MAX_ID_LEN + 1];
+	int id_len;
+	int record_length;
+};
+
+struct iso_dir {
+	struct fst_node *node;
+	struct iso_dir *parent;
+	unsigned int number;	/* in the path table */
+
+	char id[ISO_MAX_ID_LEN + 1];
+	int id_len;
+
+	struct iso_entry *entries;	/* sorted by identifier */
+	unsigned int nr_entries;
+
+	uint32_t extent;
+	uint32_t size;
+};
+
+/*
+ * The boot DOL is rewritten so that each transfer the apploader asks
+ * for starts on a sector boundary, and transfers follow each other in
+ * the file in the same order they are issued.
+ */
+struct iso_boot_dol {
+	int repacked;
+	struct dol_header header;	/* cpu endian */
+	uint32_t src_offset[DOL_MAX_SECT];
+
+	unsigned int nr_reads;
+	uint32_t read_offset[DOL_MAX_SECT];	/* in the dol */
+	uint32_t read_length[DOL_MAX_SECT];
+};
+
+struct iso_image {
+	struct iso_dir *dirs;	/* in path table order */
+	unsigned int nr_dirs;
+
+	struct fst_node **files;	/* in disc order */
+	unsigned int nr_files;
+
+	struct fst_node *boot_file;
+	struct iso_boot_dol boot_dol;
+
+	uint32_t boot_catalog;
+	uint32_t path_table_size;
+	uint32_t l_path_table;
+	uint32_t m_path_table;
+	uint32_t fst;
+	uint32_t fst_size;
+	uint32_t nr_sectors;
+
+	struct tm tm;
+};
+
+enum {
+	COPY_FILE_RANGE,
+	COPY_SENDFILE,
+	COPY_READ_WRITE,
+};
+
+static int copy_method = COPY_FILE_RANGE;
+
+
+/*
+ * Files added by fst_add_file() live outside the iso9660 tree.
+ */
+static int iso_in_tree(struct fst_node *node)
+{
+	return !node->located;
+}
+
+static uint32_t iso_sectors(uint32_t size)
+{
+	return (size + ISO_SECTOR_SIZE - 1) / ISO_SECTOR_SIZE;
+}
+
+/*
+ * Maps a name to an iso9660 identifier, "NAME.EXT;1" for files and
+ * "NAME" for directories.
+ */
+static void iso_make_id(struct iso_entry *entry)
+{
+	const char *name = entry->node->name;
+	const char *ext = NULL, *p;
+	int len = 0, base_len, ext_len = 0;
+	char c;
+
+	if (!entry->node->is_dir) {
+		ext = strrchr(name, '.');
+		if (ext == name)
+			ext = NULL;
+		if (ext)
+			ext_len = strlen(ext + 1);
+		if (ext_len > 8)
+			ext_len = 8;
+	}
+	base_len = ext ? ext - name : (int)strlen(name);
+	if (entry->node->is_dir) {
+		if (base_len > ISO_MAX_ID_LEN)
+			base_len = ISO_MAX_ID_LEN;
+	} else if (base_len + 1 + ext_len + 2 > ISO_MAX_ID_LEN) {
+		base_len = ISO_MAX_ID_LEN - 1 - ext_len - 2;
+	}
+
+	for (p = name; p < name + base_len; p++) {
+		c = *p;
+		if (c >= 'a' && c <= 'z')
+			c -= 'a' - 'A';
+		else if (!((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')))
+			c = '_';
+		entry->id[len++] = c;
+	}
+	if (!entry->node->is_dir) {
+		entry->id[len++] = '.';
+		for (p = ext ? ext + 1 : ""; *p && p < ext + 1 + ext_len; p++) {
+			c = *p;
+			if (c >= 'a' && c <= 'z')
+				c -= 'a' - 'A';
+			else if (!((c >= 'A' && c <= 'Z') ||
+				   (c >= '0' && c <= '9')))
+				c = '_';
+			entry->id[len++] = c;
+		}
+		entry->id[len++] = ';';
+		entry->id[len++] = '1';
+	}
+	entry->id[len] = '\0';
+	entry->id_len = len;
+}
+
+/*
+ *
+ */
+static int iso_compare_entries(const void *a, const void *b)
+{
+	return strcmp(((const struct iso_entry *)a)->id,
+		      ((const struct iso_entry *)b)->id);
+}
+
+/*
+ * Appends a serial number to the name part of an identifier.
+ */
+static void iso_number_id(struct iso_entry *entry, unsigned int serial)
+{
+	char tail[ISO_MAX_ID_LEN + 1] = "";
+	char suffix[12];
+	char *dot;
+	int base_len, suffix_len, tail_len;
+
+	/* file ids always have an extension separator, and only one */
+	if (!entry->node->is_dir) {
+		dot = strrchr(entry->id, '.');
+		strcpy(tail, dot);
+		*dot = '\0';
+	}
+	tail_len = strlen(tail);
+	base_len = strlen(entry->id);
+	suffix_len = sprintf(suffix, "~%u", serial);
+	if (base_len + suffix_len + tail_len > ISO_MAX_ID_LEN)
+		base_len = ISO_MAX_ID_LEN - suffix_len - tail_len;
+
+	entry->id_len = base_len + sprintf(entry->id + base_len, "%s%s",
+					   suffix, tail);
+}
+
+/*
+ * Makes identifiers clashing after mapping unique by numbering them.
+ */
+static void iso_uniquify_ids(struct iso_entry *entries, unsigned int nr)
+{
+	unsigned int i, serial = 0;
+	int clashes;
+
+	do {
+		clashes = 0;
+		qsort(entries, nr, sizeof(*entries), iso_compare_entries);
+		for (i = 1; i < nr; i++) {
+			if (strcmp(entries[i - 1].id, entries[i].id))
+				continue;
+			iso_number_id(&entries[i], ++serial);
+			clashes = 1;
+		}
+	} while (clashes);
+}
+
+/*
+ * Length of the record for an entry, its Rock Ridge entries included.
+ */
+static int iso_record_length(int id_len, int su_len)
+{
+	int length = ISO_RECORD_SIZE + id_len;
+
+	if (!(id_len & 1))
+		length++;	/* padding field */
+	length += su_len;
+	return (length + 1) & ~1;
+}
+
+/*
+ * Records never cross sector boundaries.
+ */
+static uint32_t iso_place_record(uint32_t pos, int length)
+{
+	if (pos / ISO_SECTOR_SIZE != (pos + length - 1) / ISO_SECTOR_SIZE)
+		pos = iso_sectors(pos) * ISO_SECTOR_SIZE;
+	return pos + length;
+}
+
+static int iso_dot_length(struct iso_dir *dir)
+{
+	return iso_record_length(1, dir->parent ? SUSP_PX_SIZE :
+				 SUSP_SP_SIZE + SUSP_PX_SIZE + SUSP_ER_SIZE);
+}
+
+/*
+ * Builds the entries of a directory and sizes its extent.
+ */
+static void iso_layout_dir(struct iso_dir *dir)
+{
+	struct fst_node *node = dir->node;
+	struct iso_entry *entry;
+	unsigned int i;
+	uint32_t pos;
+	int name_len;
+
+	dir->entries = xmalloc((node->nr_children + 1) * sizeof(*entry));
+	dir->nr_entries = 0;
+	for (i = 0; i < node->nr_children; i++) {
+		if (!iso_in_tree(node->children[i]))
+			continue;
+		entry = &dir->entries[dir->nr_entries++];
+		entry->node = node->children[i];
+		iso_make_id(entry);
+	}
+	iso_uniquify_ids(dir->entries, dir->nr_entries);
+
+	pos = iso_dot_length(dir) + iso_record_length(1, SUSP_PX_SIZE);
+	for (i = 0; i < dir->nr_entries; i++) {
+		entry = &dir->entries[i];
+		name_len = strlen(entry->node->name);
+		entry->record_length = iso_record_length(entry->id_len,
+							 SUSP_PX_SIZE +
+							 SUSP_NM_SIZE +
+							 name_len);
+		if (entry->record_length > 255)
+			die("%s/%s: name too long\n", node->path,
+			    entry->node->name);
+		pos = iso_place_record(pos, entry->record_length);
+	}
+	dir->size = iso_sectors(pos) * ISO_SECTOR_SIZE;
+}
+
+/*
+ *
+ */
+static void iso_count_nodes(struct fst_node *node, unsigned int *nr_dirs,
+			    unsigned int *nr_files)
+{
+	unsigned int i;
+
+	if (!iso_in_tree(node) && node->parent)
+		return;
+	if (node->is_dir)
+		(*nr_dirs)++;
+	else
+		(*nr_files)++;
+	for (i = 0; i < node->nr_children; i++)
+		iso_count_nodes(node->children[i], nr_dirs, nr_files);
+}
+
+/*
+ * Lists the files in fst order, so that walking the fst reads forward.
+ */
+static void iso_list_files(struct iso_image *iso, struct fst_node *node)
+{
+	unsigned int i;
+
+	if (!iso_in_tree(node) && node->parent)
+		return;
+	if (!node->is_dir)
+		iso->files[iso->nr_files++] = node;
+	for (i = 0; i < node->nr_children; i++)
+		iso_list_files(iso, node->children[i]);
+}
+
+/*
+ *
+ */
+static struct fst_node *iso_find_file(struct fst_node *tree, const char *path)
+{
+	struct fst_node *node = tree;
+	const char *p = path, *end;
+	unsigned int i;
+	size_t len;
+
+	while (node && *p) {
+		while (*p == '/')
+			p++;
+		end = strchr(p, '/');
+		len = end ? end - p : strlen(p);
+		if (!len)
+			break;
+		for (i = 0; i < node->nr_children; i++) {
+			if (strlen(node->children[i]->name) == len &&
+			    !memcmp(node->children[i]->name, p, len))
+				break;
+		}
+		node = (i < node->nr_children) ? node->children[i] : NULL;
+		p += len;
+	}
+	return node;
+}
+
+/*
+ * Returns the section with the lowest load address among those in the
+ * given bitmap, or -1 if the bitmap is empty.
+ * Same as the apploader.
+ */
+static int iso_lowest_dol_sect(struct dol_header *h, uint32_t sects_bitmap)
+{
+	uint32_t lowest_start = 0xffffffff;
+	int j, k;
+
+	for (j = -1, k = 0; k < DOL_MAX_SECT; k++) {
+		if (!(sects_bitmap & (1 << k)))
+			continue;
+		if (dol_sect_address(h, k) < lowest_start) {
+			lowest_start = dol_sect_address(h, k);
+			j = k;
+		}
+	}
+	return j;
+}
+
+/*
+ * Splits the DOL sections in the transfers the apploader will issue,
+ * following the same rules as al_plan_dol_read().
+ * Returns the bitmap of sections covered by the next transfer.
+ */
+static uint32_t iso_plan_dol_read(struct dol_header *h, uint32_t pending,
+				  uint32_t *offset, uint32_t *length)
+{
+	uint32_t covered, start, end, end_offset, gap;
+	int j;
+
+	j = iso_lowest_dol_sect(h, pending);
+	covered = 1 << j;
+
+	start = dol_sect_address(h, j);
+	end = start + dol_sect_size(h, j);
+	end_offset = dol_sect_offset(h, j) + dol_sect_size(h, j);
+
+	while ((j = iso_lowest_dol_sect(h, pending & ~covered)) >= 0) {
+		if (dol_sect_address(h, j) < end)
+			break;
+		gap = dol_sect_address(h, j) - end;
+		if (gap >= DI_ALIGN + 1 ||
+		    dol_sect_offset(h, j) != end_offset + gap)
+			break;
+
+		covered |= 1 << j;
+		end += gap + dol_sect_size(h, j);
+		end_offset += gap + dol_sect_size(h, j);
+	}
+
+	*length = di_align_size(end - start);
+	*offset = end_offset - (end - start);
+
+	return covered;
+}
+
+/*
+ *
+ */
+static uint32_t iso_dol_sects_bitmap(struct dol_header *h)
+{
+	uint32_t sects_bitmap = 0;
+	int i;
+
+	for (i = 0; i < DOL_MAX_SECT; i++) {
+		if (dol_sect_size(h, i))
+			sects_bitmap |= 1 << i;
+	}
+	return sects_bitmap;
+}
+
+static void iso_dol_sect_set_offset(struct dol_header *h, int index,
+				    uint32_t offset)
+{
+	if (index >= DOL_SECT_MAX_TEXT)
+		h->offset_data[index - DOL_SECT_MAX_TEXT] = offset;
+	else
+		h->offset_text[index] = offset;
+}
+
+/*
+ * Plans the layout of the boot DOL, and the transfers to load it.
+ * DOLs which don't look sane to us are left alone.
+ */
+static void iso_plan_boot_dol(struct iso_image *iso)
+{
+	struct iso_boot_dol *bd = &iso->boot_dol;
+	struct dol_header *h = &bd->header;
+	uint32_t pending, covered, offset, length, new_offset, end;
+	uint32_t words[DOL_HEADER_SIZE / sizeof(uint32_t)];
+	char *path;
+	int fd, i;
+
+	path = fst_node_path(iso->boot_file);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		die("%s: can't open: %s\n", path, strerror(errno));
+	if (pread(fd, words, sizeof(words), 0) != sizeof(words))
+		die("%s: can't read DOL header\n", path);
+	close(fd);
+
+	/* the header is packed, swap it in an aligned copy */
+	for (i = 0; i < DOL_HEADER_SIZE / sizeof(uint32_t); i++)
+		words[i] = be32_to_cpu(words[i]);
+	memcpy(h, words, sizeof(*h));
+
+	pending = iso_dol_sects_bitmap(h);
+	for (i = 0; i < DOL_MAX_SECT; i++) {
+		bd->src_offset[i] = dol_sect_offset(h, i);
+		if (!(pending & (1 << i)))
+			continue;
+		if (dol_sect_offset(h, i) < DOL_HEADER_SIZE ||
+		    (dol_sect_offset(h, i) & DI_ALIGN) ||
+		    (dol_sect_address(h, i) & DI_ALIGN) ||
+		    (uint64_t)dol_sect_offset(h, i) + dol_sect_size(h, i) >
+		    iso->boot_file->size) {
+			fprintf(stderr, "%s: unexpected DOL layout,"
+				" copied as is\n", path);
+			pending = 0;
+			break;
+		}
+	}
+
+	/* lay out the transfers one after another, sector aligned */
+	bd->repacked = (pending != 0);
+	end = DOL_HEADER_SIZE;
+	while (pending) {
+		covered = iso_plan_dol_read(h, pending, &offset, &length);
+		new_offset = iso_sectors(end) * ISO_SECTOR_SIZE;
+		for (i = 0; i < DOL_MAX_SECT; i++) {
+			if (covered & (1 << i))
+				iso_dol_sect_set_offset(h, i,
+							dol_sect_offset(h, i) -
+							offset + new_offset);
+		}
+		bd->read_offset[bd->nr_reads] = new_offset;
+		bd->read_length[bd->nr_reads++] = length;
+		end = new_offset + length;
+		pending &= ~covered;
+	}
+	if (bd->repacked)
+		iso->boot_file->size = end;
+
+	free(path);
+}
+
+/*
+ * Gets the build time, honouring SOURCE_DATE_EPOCH for reproducible images.
+ */
+static void iso_build_time(struct tm *tm)
+{
+	char *epoch = getenv("SOURCE_DATE_EPOCH");
+	time_t now;
+
+	now = epoch ? (time_t)strtoll(epoch, NULL, 10) : time(NULL);
+	gmtime_r(&now, tm);
+}
+
+/*
+ * Assigns a place in the image to every directory, file and the fst.
+ * Layout:
+ *   16  primary volume descriptor
+ *   17  boot record volume descriptor (the apploader looks for it here)
+ *   18  volume descriptor set terminator
+ *   19  boot catalog
+ *       path tables, directories, fst, files
+ */
+struct iso_image *iso_layout(struct fst_node *tree, const char *boot_file,
+			     uint32_t fst_size)
+{
+	struct iso_image *iso;
+	struct iso_dir *dir, *subdir;
+	struct fst_node *node;
+	unsigned int i, j, nr_dirs = 0, nr_files = 0;
+	uint32_t sector;
+
+	iso = xmalloc(sizeof(*iso));
+	memset(iso, 0, sizeof(*iso));
+	iso_build_time(&iso->tm);
+
+	iso->boot_file = iso_find_file(tree, boot_file);
+	if (!iso->boot_file || iso->boot_file->is_dir ||
+	    !iso_in_tree(iso->boot_file))
+		die("%s: boot file not found in disc tree\n", boot_file);
+	iso_plan_boot_dol(iso);
+	if (iso_sectors(iso->boot_file->size) * (ISO_SECTOR_SIZE / 512) >
+	    0xffff)
+		die("%s: boot file too large\n", boot_file);
+
+	iso_count_nodes(tree, &nr_dirs, &nr_files);
+	if (nr_dirs > 0xffff)
+		die("too many directories for the path table\n");
+
+	/* directories, breadth first as the path table wants them */
+	iso->dirs = xmalloc(nr_dirs * sizeof(*iso->dirs));
+	memset(iso->dirs, 0, nr_dirs * sizeof(*iso->dirs));
+	dir = &iso->dirs[iso->nr_dirs++];
+	dir->node = tree;
+	dir->number = 1;
+	dir->id_len = 1;	/* a single zero byte */
+	tree->data = dir;
+	for (i = 0; i < iso->nr_dirs; i++) {
+		dir = &iso->dirs[i];
+		iso_layout_dir(dir);
+		iso->path_table_size += 8 + ((dir->id_len + 1) & ~1);
+
+		for (j = 0; j < dir->nr_entries; j++) {
+			node = dir->entries[j].node;
+			if (!node->is_dir)
+				continue;
+			subdir = &iso->dirs[iso->nr_dirs++];
+			subdir->node = node;
+			subdir->parent = dir;
+			subdir->number = iso->nr_dirs;
+			subdir->id_len = dir->entries[j].id_len;
+			memcpy(subdir->id, dir->entries[j].id,
+			       subdir->id_len + 1);
+			node->data = subdir;
+		}
+	}
+
+	iso->files = xmalloc((nr_files + 1) * sizeof(*iso->files));
+	iso_list_files(iso, tree);
+
+	/* what the apploader reads, in the order it reads it */
+	sector = ISO_VD_SECTOR + 3;
+	iso->boot_catalog = sector++;
+	node = iso->boot_file;
+	node->disk_offset = sector * ISO_SECTOR_SIZE;
+	node->located = 1;
+	sector += iso_sectors(node->size);
+	iso->fst = sector;
+	iso->fst_size = fst_size;
+	sector += iso_sectors(fst_size);
+
+	iso->l_path_table = sector;
+	sector += iso_sectors(iso->path_table_size);
+	iso->m_path_table = sector;
+	sector += iso_sectors(iso->path_table_size);
+
+	for (i = 0; i < iso->nr_dirs; i++) {
+		dir = &iso->dirs[i];
+		dir->extent = sector;
+		dir->node->disk_offset = sector * ISO_SECTOR_SIZE;
+		dir->node->located = 1;
+		sector += dir->size / ISO_SECTOR_SIZE;
+	}
+
+	for (i = 0; i < iso->nr_files; i++) {
+		node = iso->files[i];
+		if (node == iso->boot_file)
+			continue;
+		if ((uint64_t)sector * ISO_SECTOR_SIZE + node->size >
+		    0xffffffffULL)
+			die("disc tree too large for a fst\n");
+		node->disk_offset = sector * ISO_SECTOR_SIZE;
+		node->located = 1;
+		sector += iso_sectors(node->size);
+	}
+	iso->nr_sectors = sector;
+
+	return iso;
+}
+
+/*
+ *
+ */
+uint32_t iso_fst_offset(struct iso_image *iso)
+{
+	return iso->fst * ISO_SECTOR_SIZE;
+}
+
+/*
+ *
+ */
+void iso_free(struct iso_image *iso)
+{
+	unsigned int i;
+
+	for (i = 0; i < iso->nr_dirs; i++) {
+		iso->dirs[i].node->data = NULL;
+		free(iso->dirs[i].entries);
+	}
+	free(iso->dirs);
+	free(iso->files);
+	free(iso);
+}
+
+/*
+ *
+ */
+static void iso_write_all(struct writer *w, const void *buf, size_t count)
+{
+	if (writer_write(w, buf, count) < 0)
+		die("can't write image: %s\n", strerror(errno));
+}
+
+/*
+ *
+ */
+static void iso_write_zeroes(struct writer *w, uint32_t count)
+{
+	if (writer_pad(w, count, 0) < 0)
+		die("can't write image: %s\n", strerror(errno));
+}
+
+/*
+ * Pads the last sector of an extent with zeroes.
+ * Extents start on a sector boundary, and so does the output.
+ */
+static void iso_pad_sector(struct writer *w)
+{
+	if (writer_align_to(w, ISO_SECTOR_SIZE, 0) < 0)
+		die("can't write image: %s\n", strerror(errno));
+}
+
+/*
+ *
+ */
+static void iso_set_string(char *field, size_t size, const char *s)
+{
+	size_t len = strlen(s);
+
+	memset(field, ' ', size);
+	memcpy(field, s, (len > size) ? size : len);
+}
+
+static void iso_set_date(uint8_t *date, struct tm *tm)
+{
+	date[0] = tm->tm_year;
+	date[1] = tm->tm_mon + 1;
+	date[2] = tm->tm_mday;
+	date[3] = tm->tm_hour;
+	date[4] = tm->tm_min;
+	date[5] = tm->tm_sec;
+	date[6] = 0;		/* GMT */
+}
+
+static void iso_set_vd_date(char *date, struct tm *tm)
+{
+	char buf[17];
+
+	snprintf(buf, sizeof(buf), "%04d%02d%02d%02d%02d%02d00",
+		 tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday,
+		 tm->tm_hour, tm->tm_min, tm->tm_sec);
+	memcpy(date, buf, 16);
+	date[16] = 0;		/* GMT */
+}
+
+/*
+ * Rock Ridge POSIX attributes, RRIP requires them in every record.
+ */
+static uint8_t *iso_fill_px(uint8_t *su, int is_dir)
+{
+	su[0] = 'P';
+	su[1] = 'X';
+	su[2] = SUSP_PX_SIZE;
+	su[3] = 1;
+	iso_set_733(su + 4, is_dir ? RR_DIR_MODE : RR_FILE_MODE);
+	iso_set_733(su + 12, is_dir ? 2 : 1);	/* links */
+	iso_set_733(su + 20, 0);		/* uid */
+	iso_set_733(su + 28, 0);		/* gid */
+	return su + SUSP_PX_SIZE;
+}
+
+/*
+ * Fills a directory record, returning its length.
+ * The Rock Ridge entries are left out if rr_name is NULL, and the name
+ * too if it is empty ("." and "..").
+ */
+static int iso_fill_record(struct iso_image *iso, uint8_t *buf,
+			   uint32_t extent, uint32_t size, int is_dir,
+			   const char *id, int id_len, const char *rr_name)
+{
+	struct iso_directory_record *dr = (struct iso_directory_record *)buf;
+	uint8_t *su;
+	int name_len = rr_name ? strlen(rr_name) : 0;
+	int su_len = 0, length;
+
+	if (rr_name)
+		su_len = SUSP_PX_SIZE +
+		    (name_len ? SUSP_NM_SIZE + name_len : 0);
+	length = iso_record_length(id_len, su_len);
+	memset(buf, 0, length);
+
+	dr->length = length;
+	iso_set_733(dr->extent, extent);
+	iso_set_733(dr->size, size);
+	iso_set_date(dr->date, &iso->tm);
+	dr->flags = is_dir ? ISO_FLAG_DIRECTORY : 0;
+	iso_set_723(dr->volume_sequence_number, 1);
+	dr->name_len = id_len;
+	memcpy(dr->name, id, id_len);
+
+	if (!rr_name)
+		return length;
+
+	su = (uint8_t *)dr->name + id_len + !(id_len & 1);
+	su = iso_fill_px(su, is_dir);
+	if (name_len) {
+		su[0] = 'N';
+		su[1] = 'M';
+		su[2] = SUSP_NM_SIZE + name_len;
+		su[3] = 1;
+		su[4] = 0;
+		memcpy(su + SUSP_NM_SIZE, rr_name, name_len);
+	}
+	return length;
+}
+
+/*
+ * The root "." record announces the SUSP and Rock Ridge extensions,
+ * and has its own attributes.
+ */
+static void iso_fill_root_su(uint8_t *buf)
+{
+	struct iso_directory_record *dr = (struct iso_directory_record *)buf;
+	uint8_t *su = (uint8_t *)dr->name + 1;
+
+	su[0] = 'S';
+	su[1] = 'P';
+	su[2] = SUSP_SP_SIZE;
+	su[3] = 1;
+	su[4] = 0xbe;
+	su[5] = 0xef;
+	su[6] = 0;
+	su += SUSP_SP_SIZE;
+
+	su = iso_fill_px(su, 1);
+
+	su[0] = 'E';
+	su[1] = 'R';
+	su[2] = SUSP_ER_SIZE;
+	su[3] = 1;
+	su[4] = sizeof(RR_ER_ID) - 1;
+	su[5] = sizeof(RR_ER_DESCRIPTOR) - 1;
+	su[6] = sizeof(RR_ER_SOURCE) - 1;
+	su[7] = 1;
+	su += 8;
+	memcpy(su, RR_ER_ID, sizeof(RR_ER_ID) - 1);
+	su += sizeof(RR_ER_ID) - 1;
+	memcpy(su, RR_ER_DESCRIPTOR, sizeof(RR_ER_DESCRIPTOR) - 1);
+	su += sizeof(RR_ER_DESCRIPTOR) - 1;
+	memcpy(su, RR_ER_SOURCE, sizeof(RR_ER_SOURCE) - 1);
+}
+
+/*
+ *
+ */
+static void iso_write_dir(struct iso_image *iso, struct writer *w,
+			  struct iso_dir *dir)
+{
+	struct iso_dir *parent = dir->parent ? dir->parent : dir;
+	struct iso_entry *entry;
+	struct iso_dir *subdir;
+	uint8_t *buf;
+	uint32_t pos, extent, size;
+	unsigned int i;
+	int length;
+
+	buf = xmalloc(dir->size);
+	memset(buf, 0, dir->size);
+
+	length = iso_fill_record(iso, buf, dir->extent, dir->size, 1,
+				 "\0", 1, dir->parent ? "" : NULL);
+	if (!dir->parent) {
+		buf[0] = length = iso_dot_length(dir);
+		iso_fill_root_su(buf);
+	}
+	pos = length;
+	pos += iso_fill_record(iso, buf + pos, parent->extent, parent->size,
+			       1, "\1", 1, "");
+
+	for (i = 0; i < dir->nr_entries; i++) {
+		entry = &dir->entries[i];
+		if (entry->node->is_dir) {
+			subdir = entry->node->data;
+			extent = subdir->extent;
+			size = subdir->size;
+		} else {
+			extent = entry->node->disk_offset / ISO_SECTOR_SIZE;
+			size = entry->node->size;
+		}
+		pos = iso_place_record(pos, entry->record_length) -
+		      entry->record_length;
+		pos += iso_fill_record(iso, buf + pos, extent, size,
+				       entry->node->is_dir, entry->id,
+				       entry->id_len, entry->node->name);
+	}
+
+	iso_write_all(w, buf, dir->size);
+	free(buf);
+}
+
+/*
+ *
+ */
+static void iso_write_path_table(struct iso_image *iso, struct writer *w,
+				 int msb)
+{
+	struct iso_dir *dir;
+	uint8_t *buf, *p;
+	uint32_t size = iso_sectors(iso->path_table_size) * ISO_SECTOR_SIZE;
+	unsigned int i;
+
+	buf = xmalloc(size);
+	memset(buf, 0, size);
+
+	p = buf;
+	for (i = 0; i < iso->nr_dirs; i++) {
+		dir = &iso->dirs[i];
+		p[0] = dir->id_len;
+		if (msb) {
+			iso_set_732(p + 2, dir->extent);
+			iso_set_722(p + 6, dir->parent ? dir->parent->number : 1);
+		} else {
+			iso_set_731(p + 2, dir->extent);
+			iso_set_721(p + 6, dir->parent ? dir->parent->number : 1);
+		}
+		memcpy(p + 8, dir->id, dir->id_len);
+		p += 8 + ((dir->id_len + 1) & ~1);
+	}
+
+	iso_write_all(w, buf, size);
+	free(buf);
+}
+
+/*
+ * Volume descriptors and boot catalog, sectors 16 to 19.
+ */
+static void iso_write_descriptors(struct iso_image *iso, struct writer *w)
+{
+	uint8_t buf[4 * ISO_SECTOR_SIZE];
+	struct iso_primary_descriptor *pvd = (void *)buf;
+	struct iso_boot_record *br = (void *)(buf + ISO_SECTOR_SIZE);
+	uint8_t *terminator = buf + 2 * ISO_SECTOR_SIZE;
+	uint8_t *catalog = buf + 3 * ISO_SECTOR_SIZE;
+	struct eltorito_validation_entry *ve = (void *)catalog;
+	struct eltorito_default_entry *de = (void *)(catalog + 0x20);
+	struct iso_dir *root = &iso->dirs[0];
+	uint16_t sum;
+	int i;
+
+	memset(buf, 0, sizeof(buf));
+
+	pvd->type = ISO_VD_PRIMARY;
+	memcpy(pvd->id, ISO_STANDARD_ID, sizeof(pvd->id));
+	pvd->version = 1;
+	iso_set_string(pvd->system_id, sizeof(pvd->system_id), "");
+	iso_set_string(pvd->volume_id, sizeof(pvd->volume_id), ISO_VOLUME_ID);
+	iso_set_733(pvd->volume_space_size, iso->nr_sectors);
+	iso_set_723(pvd->volume_set_size, 1);
+	iso_set_723(pvd->volume_sequence_number, 1);
+	iso_set_723(pvd->logical_block_size, ISO_SECTOR_SIZE);
+	iso_set_733(pvd->path_table_size, iso->path_table_size);
+	iso_set_731(pvd->type_l_path_table, iso->l_path_table);
+	iso_set_732(pvd->type_m_path_table, iso->m_path_table);
+	iso_fill_record(iso, pvd->root_directory_record, root->extent,
+			root->size, 1, "\0", 1, NULL);
+	iso_set_string(pvd->volume_set_id, sizeof(pvd->volume_set_id), "");
+	iso_set_string(pvd->publisher_id, sizeof(pvd->publisher_id), "");
+	iso_set_string(pvd->preparer_id, sizeof(pvd->preparer_id), "");
+	iso_set_string(pvd->application_id, sizeof(pvd->application_id),
+		       ISO_APPLICATION_ID);
+	iso_set_string(pvd->copyright_file_id,
+		       sizeof(pvd->copyright_file_id), "");
+	iso_set_string(pvd->abstract_file_id, sizeof(pvd->abstract_file_id),
+		       "");
+	iso_set_string(pvd->bibliographic_file_id,
+		       sizeof(pvd->bibliographic_file_id), "");
+	iso_set_vd_date(pvd->creation_date, &iso->tm);
+	iso_set_vd_date(pvd->modification_date, &iso->tm);
+	memset(pvd->expiration_date, '0', 16);
+	memset(pvd->effective_date, '0', 16);
+	pvd->file_structure_version = 1;
+
+	br->type = ISO_VD_BOOT_RECORD;
+	memcpy(br->id, ISO_STANDARD_ID, sizeof(br->id));
+	br->version = 1;
+	memcpy(br->boot_system_id, ELTORITO_SYSTEM_ID,
+	       sizeof(ELTORITO_SYSTEM_ID) - 1);
+	iso_set_731(br->boot_catalog, iso->boot_catalog);
+
+	terminator[0] = ISO_VD_END;
+	memcpy(terminator + 1, ISO_STANDARD_ID, 5);
+	terminator[6] = 1;
+
+	ve->header_id = 1;
+	ve->key_55 = 0x55;
+	ve->key_aa = 0xaa;
+	for (sum = 0, i = 0; i < sizeof(*ve); i += 2)
+		sum += catalog[i] | (catalog[i + 1] << 8);
+	iso_set_721(ve->checksum, -sum);
+
+	de->boot_indicator = ELTORITO_BOOTABLE;
+	de->boot_media_type = 0;
+	iso_set_721(de->sector_count, iso_sectors(iso->boot_file->size) *
+		    (ISO_SECTOR_SIZE / 512));
+	iso_set_731(de->load_rba, iso->boot_file->disk_offset /
+		    ISO_SECTOR_SIZE);
+
+	iso_write_all(w, buf, sizeof(buf));
+}
+
+/*
+ * Copies part of a file into the image without bouncing it through user
+ * space when the kernel allows.
+ * Whatever is buffered goes out first, as the kernel copies straight
+ * into the image file.
+ */
+static void iso_copy_range(struct writer *w, int in, const char *path,
+			   off_t offset, off_t length)
+{
+	char buf[64 * 1024];
+	ssize_t result;
+
+	if (copy_method != COPY_READ_WRITE && writer_flush(w) < 0)
+		die("can't write image: %s\n", strerror(errno));
+
+	while (length > 0) {
+		switch (copy_method) {
+		case COPY_FILE_RANGE:
+			result = copy_file_range(in, &offset, w->fd, NULL,
+						 length, 0);
+			if (result < 0 && (errno == EXDEV || errno == ENOSYS ||
+					   errno == EINVAL || errno == EBADF ||
+					   errno == EOPNOTSUPP)) {
+				copy_method = COPY_SENDFILE;
+				continue;
+			}
+			if (result > 0)
+				w->offset += result;
+			break;
+		case COPY_SENDFILE:
+			result = sendfile(w->fd, in, &offset, length);
+			if (result < 0 && (errno == ENOSYS || errno == EINVAL)) {
+				copy_method = COPY_READ_WRITE;
+				continue;
+			}
+			if (result > 0)
+				w->offset += result;
+			break;
+		default:
+			result = pread(in, buf, (length > sizeof(buf)) ?
+				       sizeof(buf) : length, offset);
+			if (result > 0) {
+				iso_write_all(w, buf, result);
+				offset += result;
+			}
+			break;
+		}
+		if (result < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			die("%s: can't copy: %s\n", path, strerror(errno));
+		}
+		if (result == 0)
+			die("%s: file shrank while writing image\n", path);
+		length -= result;
+	}
+}
+
+/*
+ *
+ */
+static void iso_copy_file(struct writer *w, struct fst_node *node)
+{
+	char *path;
+	int in;
+
+	path = fst_node_path(node);
+	in = open(path, O_RDONLY);
+	if (in < 0)
+		die("%s: can't open: %s\n", path, strerror(errno));
+
+	iso_copy_range(w, in, path, 0, node->size);
+
+	close(in);
+	free(path);
+
+	iso_pad_sector(w);
+}
+
+/*
+ * Writes the boot DOL with its sections at their planned offsets.
+ */
+static void iso_write_boot_dol(struct iso_image *iso, struct writer *w)
+{
+	struct iso_boot_dol *bd = &iso->boot_dol;
+	struct dol_header *dh = &bd->header;
+	uint32_t words[DOL_HEADER_SIZE / sizeof(uint32_t)];
+	uint32_t pending, pos;
+	char *path;
+	int in, i, j;
+
+	if (!bd->repacked) {
+		iso_copy_file(w, iso->boot_file);
+		return;
+	}
+
+	path = fst_node_path(iso->boot_file);
+	in = open(path, O_RDONLY);
+	if (in < 0)
+		die("%s: can't open: %s\n", path, strerror(errno));
+
+	/* the header is packed, swap it in an aligned copy */
+	memcpy(words, dh, sizeof(words));
+	for (i = 0; i < DOL_HEADER_SIZE / sizeof(uint32_t); i++)
+		words[i] = cpu_to_be32(words[i]);
+	iso_write_all(w, words, sizeof(words));
+	pos = sizeof(words);
+
+	/* sections were laid out by ascending load address */
+	pending = iso_dol_sects_bitmap(dh);
+	while ((j = iso_lowest_dol_sect(dh, pending)) >= 0) {
+		iso_write_zeroes(w, dol_sect_offset(dh, j) - pos);
+		pos = dol_sect_offset(dh, j);
+		iso_copy_range(w, in, path, bd->src_offset[j],
+			       dol_sect_size(dh, j));
+		pos += dol_sect_size(dh, j);
+		pending &= ~(1 << j);
+	}
+
+	close(in);
+	free(path);
+
+	iso_pad_sector(w);
+}
+
+/*
+ * Prints where the drive head goes on each of the apploader reads,
+ * starting from the end of the apploader itself.
+ */
+void iso_seek_report(struct iso_image *iso, FILE *f, uint32_t head)
+{
+	struct iso_boot_dol *bd = &iso->boot_dol;
+	uint32_t dol_offset = iso->boot_file->disk_offset;
+	uint32_t offset, length, seek, total = 0;
+	char what[32];
+	unsigned int i, step;
+
+	fprintf(f, "%-16s %10s %10s %10s\n", "read", "offset", "length",
+		"seek");
+	for (step = 0;; step++) {
+		if (step == 0) {
+			strcpy(what, "boot record");
+			offset = (ISO_VD_SECTOR + 1) * ISO_SECTOR_SIZE;
+			length = ELTORITO_BOOT_RECORD_READ;
+		} else if (step == 1) {
+			strcpy(what, "boot catalog");
+			offset = iso->boot_catalog * ISO_SECTOR_SIZE;
+			length = ISO_SECTOR_SIZE;
+		} else if (step == 2) {
+			strcpy(what, "dol header");
+			offset = dol_offset;
+			length = DOL_HEADER_SIZE;
+		} else if ((i = step - 3) < bd->nr_reads) {
+			sprintf(what, "dol sections %u", i + 1);
+			offset = dol_offset + bd->read_offset[i];
+			length = bd->read_length[i];
+		} else if (step == 3 + bd->nr_reads) {
+			strcpy(what, "disk header");
+			offset = 0;
+			length = sizeof(struct gcm_disk_header) + 0x2000;
+		} else if (step == 4 + bd->nr_reads && iso->fst_size) {
+			strcpy(what, "fst");
+			offset = iso->fst * ISO_SECTOR_SIZE;
+			length = di_align_size(iso->fst_size);
+		} else {
+			break;
+		}
+
+		seek = (offset > head) ? offset - head : head - offset;
+		head = offset + length;
+		total += seek;
+		fprintf(f, "%-16s 0x%08x %10u %10u\n", what, offset, length,
+			seek);
+	}
+	fprintf(f, "%-16s %10s %10s %10u\n", "total", "", "", total);
+}
+
+/*
+ * Writes the image from sector 16 on, right after the system area.
+ */
+void iso_write(struct iso_image *iso, struct writer *w, void *fst)
+{
+	unsigned int i;
+
+	iso_write_descriptors(iso, w);
+
+	iso_write_boot_dol(iso, w);
+	iso_write_all(w, fst, iso->fst_size);
+	iso_pad_sector(w);
+
+	iso_write_path_table(iso, w, 0);
+	iso_write_path_table(iso, w, 1);
+
+	for (i = 0; i < iso->nr_dirs; i++)
+		iso_write_dir(iso, w, &iso->dirs[i]);
+
+	for (i = 0; i < iso->nr_files; i++) {
+		if (iso->files[i] != iso->boot_file)
+			iso_copy_file(w, iso->files[i]);
+	}
+}
@@ -17,240 +17,544 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <pthread.h>
 
 #include "../include/lib.h"
 #include "../include/gcm.h"
+#include "../include/fst.h"
+#include "../include/cache.h"
+#include "../include/cubeboot.h"
+#include "../include/iso9660.h"
 
 #define _GNU_SOURCE
 #include <getopt.h>
 
-#define MKGBI_VERSION "V0.2-20060103"
+/* also keys the cached system areas, see system_area_key() */
+#define MKGBI_VERSION "V0.3-20261017"
 
 const char *__progname;
 
 char *apploader_bin;
 char *opening_bnr;
+char *fst_root;
+char *disc_image;
+char *boot_file;
+char *manifest;
+int nr_jobs;
+int seek_report;
 
 #define DEFAULT_OPENING_BNR GCM_OPENING_BNR
 #define DEFAULT_APPLOADER_BIN "apploader.bin"
+#define DEFAULT_BOOT_FILE "bootldr.dol"
 
 /*
- *
+ * Hashes everything that ends up in the system area.
  */
-static void default_disk_header(struct gcm_disk_header *dh)
+static void system_area_key(struct cache_key *key,
+			    struct gcm_system_area *sa)
 {
-	memset(dh, 0, sizeof(*dh));
-
-	memcpy(dh->info.game_code, "GBLP", 4);	/*Gamecube BootLoader PAL */
-	memcpy(dh->info.maker_code, "GL", 2);	/* gc-linux */
-	dh->info.magic = cpu_to_be32(0xc2339f3d);
-
-	strcpy(dh->game_name, "GAMECUBE \"EL TORITO\" BOOTLOADER");
-
-//      dh->debug_monitor_offset = cpu_to_be32(0x0001a7f4);
-//      dh->debug_monitor_address = cpu_to_be32(0x80280060);
-//      dh->layout.user_offset = cpu_to_be32(0x803ff900);
-	dh->layout.user_size = cpu_to_be32(4*1024*1024); /* 4MB */
-
-	dh->layout.disk_size = cpu_to_be32(0x56fe8000);	/* 1.4GB */
+	cache_key_init(key, "mkgbi", MKGBI_VERSION);
+	cache_key_add_string(key, cb_build_id());
+	cache_key_add(key, &sa->dh, sizeof(sa->dh));
+	cache_key_add(key, &sa->dhi, sizeof(sa->dhi));
+	cache_key_add(key, &sa->al_header, sizeof(sa->al_header));
+	cache_key_add(key, sa->al_image, sa->al_size);
+	cache_key_add(key, sa->fst_image, sa->fst_size);
+	cache_key_add(key, sa->bnr_image, sa->bnr_size);
 }
 
 /*
- * 
+ * Assembles the system area in a single buffer.
+ * The system area description is left untouched.
  */
-static void default_disk_header_info(struct gcm_disk_header_info *dhi)
+static char *build_system_area(struct gcm_system_area *sa)
 {
-	memset(dhi, 0, sizeof(*dhi));
-
-	dhi->simulated_memory_size = cpu_to_be32(0x01800000);
-	dhi->country_code = cpu_to_be32(3); /* 1=ntsc, 2=pal, 3=all */
-	dhi->unknown_1 = cpu_to_be32(1);
+	char *area;
+	int error;
+
+	area = xmalloc(SYSTEM_AREA_SIZE);
+	error = cb_gbi_build(sa, area, SYSTEM_AREA_SIZE);
+	if (error)
+		die("can't build system area: %s\n", cb_strerror(error));
+	return area;
 }
 
 /*
- *
+ * Writes the system area with one call.
  */
-static void default_apploader_header(struct gcm_apploader_header *ah)
+static int write_system_area(int fd, struct gcm_system_area *sa)
 {
-	memset(ah, 0, sizeof(*ah));
+	char *area;
+	int result;
+
+	area = build_system_area(sa);
+	result = write_full(fd, area, SYSTEM_AREA_SIZE);
+	free(area);
 
-	memcpy(ah->date, "2025/08/07", 10);
-	ah->entry_point = 0x81200000;	/* gets proper endianness later */
+	return (result < 0) ? result : 0;
 }
 
 /*
  *
  */
-static void default_system_area(struct gcm_system_area *sa)
+static int build_single_file_fst(void **fst, uint32_t * fst_size,
+				 char *fname, int flen)
 {
-	memset(sa, 0, sizeof(*sa));
+	size_t size;
 
-	default_disk_header(&sa->dh);
-	default_disk_header_info(&sa->dhi);
-	default_apploader_header(&sa->al_header);
+	cb_fst_single_file(fname, flen, NULL, 0, &size);
+	*fst = xmalloc(size);
+	cb_fst_single_file(fname, flen, *fst, size, &size);
+	*fst_size = size;
+
+	return 0;
 }
 
 /*
- *
+ * Looks for the banner in the fst currently in the image.
  */
-static void fixup_file_offsets(struct gcm_file_entry *fe, unsigned int num,
-			       unsigned long offset)
+static struct gcm_file_entry *find_banner(void *fst, uint32_t fst_size)
 {
-	while (num-- > 0)
-		fe->file.file_offset =
-		    cpu_to_be32(fe->file.file_offset + offset);
+	struct gcm_file_entry *fe = fst;
+	uint32_t i, nr_entries, fname_offset;
+	char *string_table;
+
+	nr_entries = be32_to_cpu(fe[0].root_dir.num_entries);
+	if (nr_entries * sizeof(*fe) > fst_size)
+		return NULL;
+	string_table = fst + nr_entries * sizeof(*fe);
+
+	for (i = 1; i < nr_entries; i++) {
+		fname_offset = be32_to_cpu(fe[i].file.fname_offset);
+		if (fname_offset >> 24)
+			continue;	/* directory */
+		if (nr_entries * sizeof(*fe) + fname_offset >= fst_size)
+			return NULL;
+		if (!strncmp(string_table + fname_offset, GCM_OPENING_BNR,
+			     fst_size - nr_entries * sizeof(*fe) -
+			     fname_offset))
+			return &fe[i];
+	}
+	return NULL;
 }
 
 /*
- *
+ * Replaces the fst of an iso9660 image built with our boot image by one
+ * describing the whole disc tree.
+ * The new fst is placed after the end of the image, as it usually
+ * doesn't fit in the system area.
  */
-static int write_and_pad(int fd, const void *buf, size_t count, size_t align)
+static void add_tree_fst(char *root, char *image)
 {
-	static char pad_buf[DI_ALIGN + 1];
-	int pad_len = (count & align);
-	int bytes_written, result;
-
-	if (pad_len)
-		pad_len = (align + 1) - pad_len;
-
-	result = write(fd, buf, count);
-	if (result < 0)
-		return result;
-	bytes_written = result;
-
-	result = write(fd, pad_buf, pad_len);
-	if (result < 0)
-		return result;
-	bytes_written += result;
+	struct gcm_disk_header dh;
+	struct gcm_file_entry *banner;
+	struct fst_node *tree;
+	struct stat st;
+	void *old_fst, *fst;
+	uint32_t old_fst_offset, old_fst_size, fst_size;
+	off_t fst_offset;
+	unsigned int i;
+	int fd;
+
+	fd = open(image, O_RDWR);
+	if (fd < 0)
+		die("%s: can't open image: %s\n", image, strerror(errno));
+
+	if (pread(fd, &dh, sizeof(dh), 0) != sizeof(dh) ||
+	    be32_to_cpu(dh.info.magic) != GCM_MAGIC)
+		die("%s: no boot image found\n", image);
+
+	old_fst_offset = be32_to_cpu(dh.layout.fst_offset);
+	old_fst_size = be32_to_cpu(dh.layout.fst_size);
+
+	tree = fst_scan_tree(root, nr_jobs);
+	fst_locate_in_image(tree, fd);
+
+	/* keep the banner, which lives in the system area */
+	old_fst = xmalloc(old_fst_size);
+	if (pread(fd, old_fst, old_fst_size, old_fst_offset) != old_fst_size)
+		die("%s: can't read fst: %s\n", image, strerror(errno));
+	banner = find_banner(old_fst, old_fst_size);
+	for (i = 0; banner && i < tree->nr_children; i++) {
+		if (!strcmp(tree->children[i]->name, GCM_OPENING_BNR))
+			banner = NULL;	/* the tree brings its own */
+	}
+	if (banner)
+		fst_add_file(tree, GCM_OPENING_BNR,
+			     be32_to_cpu(banner->file.file_length),
+			     be32_to_cpu(banner->file.file_offset));
+	free(old_fst);
+
+	fst = fst_build(tree, &fst_size);
+	fst_free_tree(tree);
+
+	if (fstat(fd, &st) < 0)
+		die("%s: can't stat: %s\n", image, strerror(errno));
+
+	/* drop the fst left by a previous run */
+	fst_offset = st.st_size;
+	if (old_fst_offset >= SYSTEM_AREA_SIZE &&
+	    old_fst_offset + (off_t)di_align_size(old_fst_size) >= st.st_size)
+		fst_offset = old_fst_offset;
+	fst_offset = (fst_offset + DI_SECTOR_SIZE - 1) & ~(DI_SECTOR_SIZE - 1);
+	if (fst_offset + fst_size > 0xffffffffLL)
+		die("%s: image too large for a fst\n", image);
+
+	if (ftruncate(fd, fst_offset) < 0 ||
+	    pwrite(fd, fst, fst_size, fst_offset) != fst_size ||
+	    ftruncate(fd, fst_offset + di_align_size(fst_size)) < 0)
+		die("%s: can't write fst: %s\n", image, strerror(errno));
+
+	dh.layout.fst_offset = cpu_to_be32(fst_offset);
+	dh.layout.fst_size = cpu_to_be32(fst_size);
+	dh.layout.fst_max_size = cpu_to_be32(fst_size);
+	if (pwrite(fd, &dh, sizeof(dh), 0) != sizeof(dh))
+		die("%s: can't write disk header: %s\n", image,
+		    strerror(errno));
+
+	if (close(fd) < 0)
+		die("%s: can't close image: %s\n", image, strerror(errno));
 
-	return bytes_written;
+	free(fst);
 }
 
 /*
- *
+ * Writes a complete bootable iso9660 image of a disc tree.
+ * The system area keeps just the banner, the fst describing the whole
+ * tree is placed right after the iso9660 directories.
  */
-static int write_system_area(int fd, struct gcm_system_area *sa)
+static void write_disc_image(int fd, struct gcm_system_area *sa,
+			     char *root)
 {
-	struct gcm_file_entry *fe;
-	uint32_t fst_offset;
-	int result;
-	int length;
-
-	unsigned long written_length = 0;
-
-	fst_offset = sa->dh.layout.fst_offset = sizeof(sa->dh) + 0x2000 +
-	    sizeof(sa->al_header) + di_align_size(sa->al_size);
-
-	/* disc header */
-	sa->dh.layout.fst_size = sa->dh.layout.fst_max_size = sa->fst_size;
-
-	sa->dh.layout.fst_offset = cpu_to_be32(sa->dh.layout.fst_offset);
-	sa->dh.layout.fst_size = cpu_to_be32(sa->dh.layout.fst_size);
-	sa->dh.layout.fst_max_size = cpu_to_be32(sa->dh.layout.fst_max_size);
+	struct fst_node *tree;
+	struct iso_image *iso;
+	struct writer w;
+	char *area;
+	void *fst;
+	uint32_t fst_size;
+	unsigned int i;
 
-	result = write(fd, &sa->dh, sizeof(sa->dh));
-	if (result < 0)
-		return result;
+	tree = fst_scan_tree(root, nr_jobs);
+	for (i = 0; i < tree->nr_children; i++) {
+		if (!strcmp(tree->children[i]->name, GCM_OPENING_BNR))
+			break;
+	}
+	if (i == tree->nr_children)
+		fst_add_file(tree, GCM_OPENING_BNR, sa->bnr_size,
+			     cb_gbi_banner_offset(sa));
+
+	iso = iso_layout(tree, boot_file, fst_layout_size(tree));
+	fst = fst_build(tree, &fst_size);
+
+	sa->dh.layout.fst_offset = iso_fst_offset(iso);
+	sa->dh.layout.fst_size = fst_size;
+	sa->dh.layout.fst_max_size = fst_size;
+	writer_init(&w, fd, WRITER_BUFFER_SIZE);
+	area = build_system_area(sa);
+	if (writer_write(&w, area, SYSTEM_AREA_SIZE) < 0)
+		die("can't write system area: %s\n", strerror(errno));
+	free(area);
+
+	iso_write(iso, &w, fst);
+	if (writer_release(&w) < 0)
+		die("can't write image: %s\n", strerror(errno));
+
+	/* the IPL leaves the drive right after the apploader */
+	if (seek_report)
+		iso_seek_report(iso, stderr, sizeof(sa->dh) + 0x2000 +
+				sizeof(sa->al_header) + sa->al_size);
+
+	iso_free(iso);
+	free(fst);
+	fst_free_tree(tree);
+}
 
-	written_length += sizeof(sa->dh);
+/*
+ * Checks that everything fits in the system area.
+ */
+static void check_system_area(struct gcm_system_area *sa, const char *name)
+{
+	if (cb_gbi_check(sa)) {
+		die("%s: system area overflowed"
+		    " (apploader size = %ld, fst size = %ld, banner size = %ld)\n",
+		    name, sa->al_size + 0UL, sa->fst_size + 0UL,
+		    sa->bnr_size + 0UL);
+	}
+}
 
-	/* disc header information... */
-	result = write(fd, &sa->dhi, sizeof(sa->dhi));
-	if (result < 0)
-		return result;
-	/* ... with padding */
-	result = pad_file(fd, 0x2000 - sizeof(sa->dhi));
-	if (result < 0)
-		return result;
+/*
+ * Batch mode.
+ *
+ * A manifest describes several boot images sharing most of their inputs.
+ * Each image starts with a "[outfile]" line, followed by "key = value"
+ * lines overriding the defaults:
+ *
+ *	# comment
+ *	[gbi-pal.bin]
+ *	game_code = GBLP
+ *	country_code = 2
+ *
+ * Apploaders and banners are loaded once, and the images are written
+ * in parallel.
+ */
 
-	written_length += 0x2000;
+struct batch_input {
+	char *filename;
+	struct mapped_file mf;
+};
 
-	/* apploader */
-	sa->al_header.size = sa->al_size;
+struct batch_variant {
+	char *outfile;
+	char *apploader_bin;
+	char *opening_bnr;
+	struct gcm_system_area sa;
+};
 
-	sa->al_header.entry_point = cpu_to_be32(sa->al_header.entry_point);
-	sa->al_header.size = cpu_to_be32(sa->al_header.size);
+struct batch {
+	struct batch_variant *variants;
+	unsigned int nr_variants;
 
-	result = write(fd, &sa->al_header, sizeof(sa->al_header));
-	if (result < 0)
-		return result;
-	result = write_and_pad(fd, sa->al_image, sa->al_size, DI_ALIGN);
-	if (result < 0)
-		return result;
+	struct batch_input *inputs;
+	unsigned int nr_inputs;
 
-	written_length += sizeof(sa->al_header) + result;
+	pthread_mutex_t lock;
+	unsigned int next;	/* first variant not yet taken */
+};
 
-	/* fst */
+/*
+ *
+ */
+static char *strip(char *s)
+{
+	char *end;
+
+	while (isspace((unsigned char)*s))
+		s++;
+	end = s + strlen(s);
+	while (end > s && isspace((unsigned char)end[-1]))
+		*--end = '\0';
+	return s;
+}
 
-	/* fixup file offsets */
-	fe = (struct gcm_file_entry *)sa->fst_image;
-	fixup_file_offsets(fe + 1, 1, fst_offset + di_align_size(sa->fst_size));
+/*
+ *
+ */
+static void set_variant_field(struct batch_variant *v, char *key,
+			      char *value, const char *manifest, int line)
+{
+	if (!strcmp(key, "apploader")) {
+		v->apploader_bin = strdup(value);
+	} else if (!strcmp(key, "banner")) {
+		v->opening_bnr = strdup(value);
+	} else {
+		switch (cb_gbi_set(&v->sa, key, value)) {
+		case CB_EINVAL:
+			die("%s:%d: unknown key `%s'\n", manifest, line, key);
+		case CB_EFORMAT:
+			die("%s:%d: bad value for %s: `%s'\n", manifest, line,
+			    key, value);
+		}
+	}
+}
 
-	result = write_and_pad(fd, sa->fst_image, sa->fst_size, DI_ALIGN);
-	if (result < 0)
-		return result;
+/*
+ *
+ */
+static void read_manifest(struct batch *batch, const char *manifest)
+{
+	struct batch_variant *v = NULL;
+	char buf[1024], *s, *value;
+	FILE *f;
+	int line = 0;
+
+	f = fopen(manifest, "r");
+	if (!f)
+		die("%s: can't open manifest: %s\n", manifest,
+		    strerror(errno));
+
+	while (fgets(buf, sizeof(buf), f)) {
+		line++;
+		if (!strchr(buf, '\n') && !feof(f))
+			die("%s:%d: line too long\n", manifest, line);
+		s = strip(buf);
+		if (!*s || *s == '#')
+			continue;
+
+		if (*s == '[') {
+			value = s + strlen(s) - 1;
+			if (*value != ']')
+				die("%s:%d: missing `]'\n", manifest, line);
+			*value = '\0';
+			s = strip(s + 1);
+			if (!*s)
+				die("%s:%d: missing output file\n",
+				    manifest, line);
+
+			batch->variants = xrealloc(batch->variants,
+						   (batch->nr_variants + 1) *
+						   sizeof(*batch->variants));
+			v = &batch->variants[batch->nr_variants++];
+			v->outfile = strdup(s);
+			v->apploader_bin = apploader_bin;
+			v->opening_bnr = opening_bnr;
+			cb_gbi_defaults(&v->sa);
+			continue;
+		}
 
-	written_length += result;
+		if (!v)
+			die("%s:%d: `key = value' outside of an image\n",
+			    manifest, line);
+		value = strchr(s, '=');
+		if (!value)
+			die("%s:%d: missing `='\n", manifest, line);
+		*value++ = '\0';
+		set_variant_field(v, strip(s), strip(value), manifest, line);
+	}
+	if (ferror(f))
+		die("%s: can't read manifest: %s\n", manifest,
+		    strerror(errno));
+	fclose(f);
 
-	/* opening.bnr */
-	result = write_and_pad(fd, sa->bnr_image, sa->bnr_size, DI_ALIGN);
-	if (result < 0)
-		return result;
+	if (!batch->nr_variants)
+		die("%s: no images in manifest\n", manifest);
+}
 
-	written_length += result;
+/*
+ * Loads a file shared by several variants, just once.
+ */
+static struct batch_input *batch_load(struct batch *batch, char *filename)
+{
+	struct batch_input *input;
+	unsigned int i;
 
-	/* padding */
-	result = pad_file(fd, SYSTEM_AREA_SIZE - written_length);
-	if (result < 0)
-		return result;
+	for (i = 0; i < batch->nr_inputs; i++) {
+		if (!strcmp(batch->inputs[i].filename, filename))
+			return &batch->inputs[i];
+	}
 
-	return 0;
+	batch->inputs = xrealloc(batch->inputs, (batch->nr_inputs + 1) *
+				 sizeof(*batch->inputs));
+	input = &batch->inputs[batch->nr_inputs++];
+	input->filename = filename;
+	map_file(filename, &input->mf);
+	return input;
 }
 
 /*
  *
  */
-static int build_single_file_fst(void **fst, uint32_t * fst_size,
-				 char *fname, int flen)
+static void write_variant(struct batch_variant *v)
 {
-	struct gcm_file_entry *fe;
-	void *new_fst;
-
-	int file_entry_table_size = 2 * sizeof(struct gcm_file_entry);
-	int string_table_size = strlen(fname) + 1;
-	int new_fst_size = file_entry_table_size + string_table_size;
-
-	new_fst = malloc(new_fst_size);
-	if (!new_fst)
-		die("not enough memory for fst\n");
+	struct gcm_system_area *sa = &v->sa;
+	struct cache_key key;
+	void *fst;
+	uint32_t fst_size;
+	int fd;
+
+	build_single_file_fst(&fst, &fst_size, GCM_OPENING_BNR,
+			      sa->bnr_size);
+	sa->fst_image = fst;
+	sa->fst_size = fst_size;
+	check_system_area(sa, v->outfile);
+
+	system_area_key(&key, sa);
+	if (cache_fetch(&key, v->outfile))
+		goto out;
+
+	fd = open(v->outfile, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0)
+		die("%s: can't open output file: %s\n", v->outfile,
+		    strerror(errno));
+	if (write_system_area(fd, sa) < 0)
+		die("%s: can't write system area: %s\n", v->outfile,
+		    strerror(errno));
+	if (close(fd) < 0)
+		die("%s: can't close output file: %s\n", v->outfile,
+		    strerror(errno));
+	cache_store(&key, v->outfile);
+
+out:
+	sa->fst_image = NULL;
+	free(fst);
+}
 
-	/* zero out values */
-	memset(new_fst, 0, new_fst_size);
+/*
+ *
+ */
+static void *batch_worker(void *arg)
+{
+	struct batch *batch = arg;
+	unsigned int i;
 
-	fe = new_fst;
+	for (;;) {
+		pthread_mutex_lock(&batch->lock);
+		i = batch->next;
+		if (i < batch->nr_variants)
+			batch->next++;
+		pthread_mutex_unlock(&batch->lock);
 
-	/* root directory */
-	fe[0].flags = 1;	/* directory */
-	fe[0].root_dir.num_entries = cpu_to_be32(2);
+		if (i >= batch->nr_variants)
+			break;
+		write_variant(&batch->variants[i]);
+	}
+	return NULL;
+}
 
-	/*
-	 * The file_offset value needs to be fixed afterwards adding the
-	 * final location of the file in the disc image.
-	 */
-	fe[1].file.fname_offset = 0;	/* in string table */
-	fe[1].file.file_offset = 0;	/* needs fixup afterwards */
-	fe[1].file.file_length = cpu_to_be32(flen);
-	strcpy(new_fst + file_entry_table_size, fname);
+/*
+ * Writes every image described in a manifest.
+ */
+static void write_batch(const char *manifest)
+{
+	struct batch batch;
+	struct batch_variant *v;
+	struct batch_input *input;
+	pthread_t *threads;
+	unsigned int i;
+	int nr_threads, error;
+
+	memset(&batch, 0, sizeof(batch));
+	read_manifest(&batch, manifest);
+
+	for (i = 0; i < batch.nr_variants; i++) {
+		v = &batch.variants[i];
+		input = batch_load(&batch, v->apploader_bin);
+		v->sa.al_image = input->mf.data;
+		v->sa.al_size = input->mf.size;
+		input = batch_load(&batch, v->opening_bnr);
+		v->sa.bnr_image = input->mf.data;
+		v->sa.bnr_size = input->mf.size;
+	}
 
-	*fst = new_fst;
-	*fst_size = new_fst_size;
+	nr_threads = nr_jobs;
+	if (nr_threads > batch.nr_variants)
+		nr_threads = batch.nr_variants;
 
-	return 0;
+	pthread_mutex_init(&batch.lock, NULL);
+	threads = xmalloc(nr_threads * sizeof(*threads));
+	for (i = 0; i < nr_threads; i++) {
+		error = pthread_create(&threads[i], NULL, batch_worker, &batch);
+		if (error)
+			die("can't create thread: %s\n", strerror(error));
+	}
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+	pthread_mutex_destroy(&batch.lock);
+	free(threads);
+
+	for (i = 0; i < batch.nr_inputs; i++)
+		unmap_file(&batch.inputs[i].mf);
+	free(batch.inputs);
+	for (i = 0; i < batch.nr_variants; i++)
+		free(batch.variants[i].outfile);
+	free(batch.variants);
+
+	cache_report(stderr);
 }
 
 /*
@@ -273,7 +577,18 @@ void usage(void)
 		"      (default `apploader.bin')" "\n"
 		"  -b, --banner=FILE       use banner from file" "\n"
 		"      (default `openning.bnr')" "\n"
-		"  -o, --outfile=PATH      output file (default stdout)" "\n",
+		"  -o, --outfile=PATH      output file (default stdout)" "\n"
+		"  -r, --root=DIR          write a bootable iso9660 image of the" "\n"
+		"      disc tree DIR, instead of just the boot image" "\n"
+		"  -B, --boot=FILE         DOL to boot, relative to DIR" "\n"
+		"      (default `bootldr.dol')" "\n"
+		"  -s, --seek-report       show the expected drive seeks on boot" "\n"
+		"  -i, --image=FILE        don't write an image, but replace the" "\n"
+		"      fst of FILE, built from DIR by mkisofs" "\n"
+		"  -m, --manifest=FILE     write every boot image described in" "\n"
+		"      FILE, instead of a single one" "\n"
+		"  -j, --jobs=N            scan DIR, or write the images of FILE," "\n"
+		"      with N threads (default one per cpu)" "\n",
 		__progname);
 	exit(1);
 }
@@ -310,21 +625,30 @@ int main(int argc, char *argv[])
 	struct gcm_system_area sa;
 	void *fst;
 	uint32_t fst_size;
+	struct mapped_file apploader, banner;
+	struct cache_key key;
+	int use_cache = 0;
 
 	struct option long_options[] = {
 		{"apploader", 1, NULL, 'a'},
 		{"banner", 1, NULL, 'b'},
 		{"outfile", 1, NULL, 'o'},
+		{"root", 1, NULL, 'r'},
+		{"image", 1, NULL, 'i'},
+		{"boot", 1, NULL, 'B'},
+		{"seek-report", 0, NULL, 's'},
+		{"jobs", 1, NULL, 'j'},
+		{"manifest", 1, NULL, 'm'},
 		{"version", 0, NULL, 'v'},
 		{"help", 0, NULL, 'h'},
 		{0, 0, 0, 0}
 	};
-#define SHORT_OPTIONS "a:b:o:vh"
+#define SHORT_OPTIONS "a:b:o:r:i:B:sj:m:vh"
 
 	p = strrchr(argv[0], '/');
 	__progname = (p && p[1]) ? p + 1 : argv[0];
 
-	default_system_area(&sa);
+	cb_gbi_defaults(&sa);
 
 	while ((ch = getopt_long(argc, argv, SHORT_OPTIONS,
 				 long_options, NULL)) != -1) {
@@ -340,6 +664,26 @@ int main(int argc, char *argv[])
 		case 'o':
 			outfile = optarg;
 			break;
+		case 'r':
+			fst_root = optarg;
+			break;
+		case 'i':
+			disc_image = optarg;
+			break;
+		case 'B':
+			boot_file = optarg;
+			break;
+		case 's':
+			seek_report = 1;
+			break;
+		case 'j':
+			nr_jobs = strtol(optarg, &p, 0);
+			if (*p || nr_jobs < 1)
+				usage();
+			break;
+		case 'm':
+			manifest = optarg;
+			break;
 		case 'v':
 			version();
 			break;
@@ -355,27 +699,52 @@ int main(int argc, char *argv[])
 		usage();
 	}
 
+	if (!nr_jobs)
+		nr_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (disc_image) {
+		if (!fst_root)
+			usage();
+		add_tree_fst(fst_root, disc_image);
+		return 0;
+	}
+
 	if (!apploader_bin)
 		apploader_bin = DEFAULT_APPLOADER_BIN;
 	if (!opening_bnr)
 		opening_bnr = DEFAULT_OPENING_BNR;
 
-	sa.al_image = slurp_file(apploader_bin, &sa.al_size);
-
-	sa.bnr_image = slurp_file(opening_bnr, &sa.bnr_size);
-	build_single_file_fst(&fst, &fst_size, GCM_OPENING_BNR, sa.bnr_size);
-
-	sa.fst_image = fst;
-	sa.fst_size = fst_size;
+	if (manifest) {
+		if (outfile || fst_root)
+			usage();
+		write_batch(manifest);
+		return 0;
+	}
 
-	if (sizeof(sa.dh) + 0x2000 + sizeof(sa.al_header) +
-	    di_align_size(sa.al_size) + di_align_size(sa.fst_size) +
-	    di_align_size(sa.bnr_size) > SYSTEM_AREA_SIZE) {
-		die("system area overflowed"
-		    " (apploader size = %ld, fst size = %ld, banner size = %ld)\n",
-		    sa.al_size + 0UL, sa.fst_size + 0UL, sa.bnr_size + 0UL);
+	map_file(apploader_bin, &apploader);
+	sa.al_image = apploader.data;
+	sa.al_size = apploader.size;
+
+	map_file(opening_bnr, &banner);
+	sa.bnr_image = banner.data;
+	sa.bnr_size = banner.size;
+	if (fst_root) {
+		/* the fst goes outside the system area */
+		fst = NULL;
+		if (!boot_file)
+			boot_file = DEFAULT_BOOT_FILE;
+	} else {
+		build_single_file_fst(&fst, &fst_size, GCM_OPENING_BNR,
+				      sa.bnr_size);
+		sa.fst_image = fst;
+		sa.fst_size = fst_size;
 	}
 
+	if (!outfile || !strcmp(outfile, "-"))
+		check_system_area(&sa, "*stdout*");
+	else
+		check_system_area(&sa, outfile);
+
 	if (!outfile) {
 		outfile = "*stdout*";
 		fout = stdout;
@@ -384,6 +753,15 @@ int main(int argc, char *argv[])
 			outfile = "*stdout*";
 			fout = stdout;
 		} else {
+			/* whole disc images are not worth caching */
+			use_cache = !fst_root;
+			if (use_cache) {
+				system_area_key(&key, &sa);
+				if (cache_fetch(&key, outfile)) {
+					cache_report(stderr);
+					goto out;
+				}
+			}
 			fout = fopen(outfile, "w");
 			if (!fout) {
 				die("%s: can't open output file: %s\n",
@@ -393,9 +771,22 @@ int main(int argc, char *argv[])
 	}
 
 	fflush(fout);
-	write_system_area(fileno(fout), &sa);
-	fclose(fout);
+	if (fst_root)
+		write_disc_image(fileno(fout), &sa, fst_root);
+	else if (write_system_area(fileno(fout), &sa) < 0)
+		die("%s: can't write system area: %s\n", outfile,
+		    strerror(errno));
+	if (fclose(fout))
+		die("%s: can't close output file: %s\n", outfile,
+		    strerror(errno));
+	if (use_cache) {
+		cache_store(&key, outfile);
+		cache_report(stderr);
+	}
 
+out:
+	unmap_file(&banner);
+	unmap_file(&apploader);
 	free(fst);
 
 	return 0;
@@ -25,11 +25,7 @@
 
 #include "../include/lib.h"
 #include "../include/gcm.h"
-
-
-struct gcm_disk_header boot_bin;
-struct gcm_disk_header_info bi2_bin;
-struct gcm_apploader_header appldr_bin;
+#include "../include/cubeboot.h"
 
 #define BUF_SIZE 4096
 static char buf[BUF_SIZE];
@@ -149,17 +145,18 @@ int dump_file(int fd, struct gcm_file_entry *fe, char *fname)
 }
 #endif
 
-void print_file_entry(int fd, struct gcm_file_entry *fe, void *fst, char *string_table)
+void print_file_entry(int fd, struct gcm_file_entry *fe, struct cb_gcm_fst *fst)
 {
 	unsigned long fname_offset;
-	char *fname;
+	const char *fname;
 
 	printf("-- file entry --\n");
 
 	printf("type = %s\n", (fe->flags)?"directory":"file");
 	fname_offset = be32_to_cpu(fe->file.fname_offset) & 0x00ffffff;
 	printf("fname_offset = 0x%08x\n", fname_offset);
-	printf("fname = %s\n", fname = string_table + fname_offset);
+	fname = cb_gcm_entry_name(fst, fe);
+	printf("fname = %s\n", fname ? fname : "*bad name*");
 
 	if (fe->flags) {
 		printf("parent_directory_offset = 0x%08x\n",
@@ -175,7 +172,7 @@ void print_file_entry(int fd, struct gcm_file_entry *fe, void *fst, char *string
 }
 
 int parse_directory(int fd, struct gcm_file_entry *fe, struct gcm_file_entry *parent_fe,
-		    void *fst, char *string_table)
+		    struct cb_gcm_fst *fst)
 {
 	struct gcm_file_entry *next_fe;
 	unsigned long parent_directory_offset;
@@ -186,51 +183,40 @@ int parse_directory(int fd, struct gcm_file_entry *fe, struct gcm_file_entry *pa
 	parent_directory_offset = be32_to_cpu(fe->dir.parent_directory_offset);
 
 	if (parent_fe) {
-		directory_offset = (void *)parent_fe - fst;
+		directory_offset = (void *)parent_fe - (void *)fst->entries;
 		if (directory_offset != parent_directory_offset) {
 			die("bug in parser, claimed parent not parent!\n");
 		}
 	}
 
-	print_file_entry(fd, fe, fst, string_table);
-	printf("this offset = %p\n", (void *)fe - fst);
+	print_file_entry(fd, fe, fst);
+	printf("this offset = %p\n", (void *)fe - (void *)fst->entries);
 }
 
-int parse_fst(int fd, struct gcm_disk_header *dh)
+int parse_fst(int fd, void *image, size_t size, struct gcm_disk_header *dh)
 {
-	void *fst;
-	unsigned long fst_size;
+	struct cb_gcm_fst fst;
 	struct gcm_file_entry *fe;
-
-	char *string_table;
 	unsigned long string_table_offset;
-
 	int num_entries;
-
-	int result;
+	int error;
 
 	printf("\n== FST parser ==\n");
 
-	fst_size = be32_to_cpu(dh->layout.fst_size);
-	fst = malloc(fst_size);
-	if (!fst)
-		die("can't allocate memory for fst\n");
-
-	result = read(fd, fst, fst_size);
-	if (result < 0)
-		die("can't read fst: %s", strerror(errno));
+	error = cb_gcm_fst(image, size, dh, &fst);
+	if (error)
+		die("can't locate fst: %s\n", cb_strerror(error));
 
-	fe = (struct gcm_file_entry *)fst;
+	fe = (struct gcm_file_entry *)fst.entries;
 
-	num_entries = be32_to_cpu(fe->root_dir.num_entries);
+	num_entries = fst.nr_entries;
 	string_table_offset = be32_to_cpu(dh->layout.fst_offset) +
 				 num_entries * sizeof(*fe);
-	string_table = fst + num_entries * sizeof(*fe);
 
-	printf("fst loaded at address %p\n", fst);
+	printf("fst loaded at address %p\n", fst.entries);
 	printf("fst has %d file entries\n", num_entries);
 
-	printf("string table loaded at address %p\n", string_table);
+	printf("string table loaded at address %p\n", fst.string_table);
 	printf("string table located at offset 0x%08x\n", string_table_offset);
 
 	/* skip root directory */
@@ -238,7 +224,7 @@ int parse_fst(int fd, struct gcm_disk_header *dh)
 	num_entries--;
 
 	while (num_entries > 0) {
-		parse_directory(fd, fe, NULL, fst, string_table);
+		parse_directory(fd, fe, NULL, &fst);
 		fe++;
 		num_entries--;
 	}
@@ -249,34 +235,21 @@ int parse_fst(int fd, struct gcm_disk_header *dh)
  */
 int main(int argc, char *argv[])
 {
-	int result;
-
-	result = read(0, &boot_bin, sizeof(boot_bin));
-	if (result < 0)
-		die("can't read boot.bin: %s", strerror(errno));
-
-	print_disk_header(&boot_bin);
+	struct mapped_file mf;
+	struct cb_gcm_info info;
+	int error;
 
-	result = read(0, &bi2_bin, sizeof(bi2_bin));
-	if (result < 0)
-		die("can't read bi2.bin: %s", strerror(errno));
+	map_fd(0, "*stdin*", &mf);
 
-	print_disk_header_information(&bi2_bin);
+	error = cb_gcm_parse(mf.data, mf.size, &info);
+	if (error)
+		die("can't read disc headers: %s\n", cb_strerror(error));
 
-	result = lseek(0, 0x2440, SEEK_SET);
-	if (result < 0)
-		die("can't seek to appldr.bin position: %s", strerror(errno));
+	print_disk_header(&info.dh);
+	print_disk_header_information(&info.dhi);
+	print_apploader_header(&info.ah);
 
-	result = read(0, &appldr_bin, sizeof(appldr_bin));
-	if (result < 0)
-		die("can't read appldr.bin header: %s", strerror(errno));
+	parse_fst(0, mf.data, mf.size, &info.dh);
 
-	print_apploader_header(&appldr_bin);
-
-	result = lseek(0, be32_to_cpu(boot_bin.layout.fst_offset), SEEK_SET);
-	if (result < 0)
-		die("can't seek to fst.bin position: %s", strerror(errno));
-
-	parse_fst(0, &boot_bin);
+	unmap_file(&mf);
 }
-
@@ -15,13 +15,19 @@
  *
  */
 
+#ifndef PATCH_IPL
 #define PATCH_IPL 1
+#endif
+#ifndef RESET_DVD
 #define RESET_DVD 0
+#endif
 
 #include <stddef.h>
 #include <string.h>
 
 #include "../include/system.h"
+#include "../include/debug.h"
+#include "../include/trace.h"
 
 #include "../../include/gcm.h"
 #include "../../include/dol.h"
@@ -30,9 +36,9 @@
 #define DI_ALIGN_SIZE	(1UL << DI_ALIGN_SHIFT)
 #define DI_ALIGN_MASK	(~((1 << DI_ALIGN_SHIFT) - 1))
 
-#define di_align(addr)	(void *) \
-			((((unsigned long)(addr)) + \
+#define di_align_len(len)	((((unsigned long)(len)) + \
 				 DI_ALIGN_SIZE - 1) & DI_ALIGN_MASK)
+#define di_align(addr)		((void *)di_align_len(addr))
 
 /*
  * DVD data structures
@@ -160,6 +166,16 @@ static struct bootloader_control bl_control = { .size = ~0 };
 static unsigned char di_buffer[DI_SECTOR_SIZE] __attribute__ ((aligned(32))) =
 	"www.gc-linux.org";
 
+/*
+ * boot.bin followed by bi2.bin, as found at the start of the disc.
+ * They are read to the top of MEM1, where the fst goes later, and bi2.bin
+ * ends up exactly where it is kept when there is no fst. Keeping a
+ * buffer for them in the apploader would not fit in the system area.
+ */
+#define AL_DISK_HEADER_SIZE	(sizeof(struct gcm_disk_header) + 0x2000)
+#define AL_DISK_HEADER_ADDRESS	((0x81800000 - AL_DISK_HEADER_SIZE) & \
+				 DI_ALIGN_MASK)
+
 #if PATCH_IPL > 0
 static void patch_ipl(void);
 #if PATCH_IPL > 1
@@ -173,6 +189,9 @@ static void skip_ipl_animation(void);
  */
 void al_start(void **enter, void **load, void **exit)
 {
+	trace_init();
+	trace_event(BOOT_TRACE_AL_START, 0);
+
 	al_control.step = 0;
 
 	*enter = al_enter;
@@ -180,7 +199,9 @@ void al_start(void **enter, void **load, void **exit)
 	*exit = al_exit;
 
 #if PATCH_IPL > 0
+	trace_event(BOOT_TRACE_AL_PATCH_IPL, 0);
 	patch_ipl();
+	trace_event(BOOT_TRACE_AL_PATCH_IPL_DONE, 0);
 #endif
 }
 
@@ -205,6 +226,70 @@ static int al_load_dol_sects_bitmap(struct dol_header *h)
 	return sects_bitmap;
 }
 
+/*
+ * Returns the section with the lowest load address among those in the
+ * given bitmap, or -1 if the bitmap is empty.
+ */
+static int al_lowest_dol_sect(struct dol_header *h, uint32_t sects_bitmap)
+{
+	unsigned long lowest_start = 0xffffffff;
+	int j, k;
+
+	for (j = -1, k = 0; k < DOL_MAX_SECT; k++) {
+		if (!(sects_bitmap & (1 << k)))
+			continue;
+		if (dol_sect_address(h, k) < lowest_start) {
+			lowest_start = dol_sect_address(h, k);
+			j = k;
+		}
+	}
+	return j;
+}
+
+/*
+ * Plans the next DOL read.
+ *
+ * Starting with the pending section with the lowest load address, merges
+ * into a single transfer all following sections which are laid out the
+ * same way in the file and in memory, allowing only for the alignment
+ * padding between them.
+ * Returns the bitmap of sections covered by the transfer.
+ */
+static uint32_t al_plan_dol_read(struct dol_header *h, uint32_t pending,
+				 void **address, uint32_t *length,
+				 uint32_t *offset)
+{
+	uint32_t covered;
+	unsigned long start, end, end_offset, gap;
+	int j;
+
+	j = al_lowest_dol_sect(h, pending);
+	covered = 1 << j;
+
+	start = dol_sect_address(h, j);
+	end = start + dol_sect_size(h, j);
+	end_offset = dol_sect_offset(h, j) + dol_sect_size(h, j);
+
+	while ((j = al_lowest_dol_sect(h, pending & ~covered)) >= 0) {
+		if (dol_sect_address(h, j) < end)
+			break;
+		gap = dol_sect_address(h, j) - end;
+		if (gap >= DI_ALIGN_SIZE ||
+		    dol_sect_offset(h, j) != end_offset + gap)
+			break;
+
+		covered |= 1 << j;
+		end += gap + dol_sect_size(h, j);
+		end_offset += gap + dol_sect_size(h, j);
+	}
+
+	*address = (void *)start;
+	*length = di_align_len(end - start);
+	*offset = end_offset - (end - start);
+
+	return covered;
+}
+
 /*
  * Checks if the DOL we are trying to boot is appropiate enough.
  */
@@ -223,13 +308,13 @@ static void al_check_dol(struct dol_header *h, int dol_length)
 
 		/* offsets must be aligned to 32 bytes */
 		value = dol_sect_offset(h, i);
-		if (value != (uint32_t) di_align(value)) {
+		if (value != di_align_len(value)) {
 			panic("detected unaligned section offset\n");
 		}
 
 		/* addresses must be aligned to 32 bytes */
 		value = dol_sect_address(h, i);
-		if (value != (uint32_t) di_align(value)) {
+		if (value != di_align_len(value)) {
 			panic("unaligned section address\n");
 		}
 
@@ -298,11 +383,18 @@ static void al_check_default_entry(struct di_default_entry *de)
  */
 static void al_enter(void (*report) (char *text, ...))
 {
+	trace_event(BOOT_TRACE_AL_ENTER, 0);
+
 	al_control.step = 1;
 	al_control.report = report;
 	if (report)
 		report("\"El Torito\" apploader\n");
 
+#ifdef DEBUG
+	gcn_con_init();
+#endif
+	dbg_printf("\"El Torito\" apploader\n");
+
 }
 
 /*
@@ -314,18 +406,22 @@ static int al_load(void **address, uint32_t *length, uint32_t *offset)
 	struct di_boot_record *br;
 	struct di_validation_entry *validation_entry;
 	struct di_default_entry *default_entry;
+	uint32_t boot_catalog_offset, load_rba;
+	uint16_t sector_count;
 
 	struct gcm_disk_header *disk_header;
-	struct gcm_disk_header_info *disk_header_info;
 
 	struct dol_header *dh;
-	unsigned long lowest_start;
-	int j, k;
+	uint32_t covered;
+	int k;
 
 	int need_more = 1; /* this tells the IPL if we need more data or not */
 
+	trace_event(BOOT_TRACE_AL_LOAD, al_control.step);
+
 	if (al_control.report)
 		al_control.report("step %d\n", al_control.step);
+	dbg_printf("al: step %d\n", al_control.step);
 
 	switch (al_control.step) {
 	case 0:
@@ -335,7 +431,7 @@ static int al_load(void **address, uint32_t *length, uint32_t *offset)
 
 		/* read sector 17, containing Boot Record Volume */
 		*address = di_buffer;
-		*length = (uint32_t) di_align(sizeof(*br));
+		*length = di_align_len(sizeof(*br));
 		*offset = 17 * DI_SECTOR_SIZE;
 		invalidate_dcache_range(*address, *address + *length);
 
@@ -350,12 +446,14 @@ static int al_load(void **address, uint32_t *length, uint32_t *offset)
 			panic("Can't find EL TORITO boot record\n");
 		}
 
-		le32_to_cpus(&br->boot_catalog_offset);
+		/* little endian, swapped in an aligned copy */
+		boot_catalog_offset = br->boot_catalog_offset;
+		le32_to_cpus(&boot_catalog_offset);
 
 		/* read the boot catalog */
 		*address = di_buffer;
 		*length = DI_SECTOR_SIZE;
-		*offset = br->boot_catalog_offset * DI_SECTOR_SIZE;
+		*offset = boot_catalog_offset * DI_SECTOR_SIZE;
 		invalidate_dcache_range(*address, *address + *length);
 
 		al_control.step++;
@@ -371,11 +469,13 @@ static int al_load(void **address, uint32_t *length, uint32_t *offset)
 		default_entry = (struct di_default_entry *)(di_buffer + 0x20);
 		al_check_default_entry(default_entry);
 
-		le16_to_cpus(&default_entry->sector_count);
-		le32_to_cpus(&default_entry->load_rba);
+		sector_count = default_entry->sector_count;
+		le16_to_cpus(&sector_count);
+		load_rba = default_entry->load_rba;
+		le32_to_cpus(&load_rba);
 
-		bl_control.size = default_entry->sector_count * 512;
-		bl_control.offset = default_entry->load_rba * DI_SECTOR_SIZE;
+		bl_control.size = sector_count * 512;
+		bl_control.offset = load_rba * DI_SECTOR_SIZE;
 
 		/* request the .dol header */
 		*address = di_buffer;
@@ -393,11 +493,24 @@ static int al_load(void **address, uint32_t *length, uint32_t *offset)
 
 		/* extra work on first visit */
 		if (bl_control.sects_bitmap == 0xdeadbeef) {
+			/* the header is big endian, nothing to do natively */
+			for (k = 0; k < sizeof(*dh) / sizeof(uint32_t); k++)
+				be32_to_cpus((uint32_t *)dh + k);
+
 			/* sanity checks here */
+			dbg_dump_ref(dh);
 			al_check_dol(dh, bl_control.size);
 
+			/* keep the trace ring out of the way of the DOL */
+			for (k = 0; k < DOL_MAX_SECT; k++)
+				trace_reserve(dol_sect_address(dh, k),
+					      dol_sect_address(dh, k) +
+					      di_align_len(dol_sect_size(dh, k)));
+			trace_reserve(dh->address_bss,
+				      dh->address_bss + dh->size_bss);
+
 			/* save our entry point */
-			bl_control.entry_point = (void *)dh->entry_point;
+			bl_control.entry_point = (void *)(uintptr_t)dh->entry_point;
 
 			/* pending and valid sections, respectively */
 			bl_control.sects_bitmap = 0;
@@ -408,40 +521,31 @@ static int al_load(void **address, uint32_t *length, uint32_t *offset)
 		 * Load the sections in ascending order.
 		 * We need this because we are loading a bit more of data than
 		 * strictly necessary on DOLs with unaligned lengths.
+		 * Sections contiguous both in the file and in memory are
+		 * requested in one go.
 		 */
+		covered = al_plan_dol_read(dh, bl_control.all_sects_bitmap &
+					   ~bl_control.sects_bitmap,
+					   address, length, offset);
+		*offset += bl_control.offset;
 
-		/* find lowest start address for a pending section */
-		lowest_start = 0xffffffff;
-		for (j = -1, k = 0; k < DOL_MAX_SECT; k++) {
-			/* continue if section is already done */
-			if ((bl_control.sects_bitmap & (1 << k)) != 0)
-				continue;
-			/* do nothing for non sections */
-			if (!(bl_control.all_sects_bitmap & (1 << k)))
-				continue;
-			/* found new candidate */
-			if (dol_sect_address(dh, k) < lowest_start) {
-				lowest_start = dol_sect_address(dh, k);
-				j = k;
-			}
-		}
-		/* mark section as being loaded */
-		bl_control.sects_bitmap |= (1 << j);
-
-		/* request a .dol section */
-		*address = (void *)dol_sect_address(dh, j);;
-		*length = (uint32_t) di_align(dol_sect_size(dh, j));
-		*offset = bl_control.offset + dol_sect_offset(dh, j);
+		/* mark sections as being loaded */
+		bl_control.sects_bitmap |= covered;
 
 		invalidate_dcache_range(*address, *address + *length);
-		if (dol_sect_is_text(dh, j))
-			invalidate_icache_range(*address, *address + *length);
+		for (k = 0; k < DOL_SECT_MAX_TEXT; k++) {
+			if (covered & (1 << k)) {
+				invalidate_icache_range(*address,
+							*address + *length);
+				break;
+			}
+		}
 
 		/* check if we are going to be done with all sections */
 		if (bl_control.sects_bitmap == bl_control.all_sects_bitmap) {
 			/* setup .bss section */
 			if (dh->size_bss)
-				memset((void *)dh->address_bss, 0,
+				memset((void *)(uintptr_t)dh->address_bss, 0,
 				       dh->size_bss);
 
 			/* bye, bye */
@@ -451,48 +555,53 @@ static int al_load(void **address, uint32_t *length, uint32_t *offset)
 	case 5:
 		/* all .dol sections loaded */
 
-		/* read sector 0, containing disk header and disk header info */
-		*address = di_buffer;
-		*length = (uint32_t) di_align(sizeof(*disk_header) + sizeof(*disk_header_info));
+		/*
+		 * Read boot.bin and bi2.bin in one go.
+		 * The IPL only leaves the disk id in lowmem, so the disk
+		 * layout has to come from the disc.
+		 */
+		*address = (void *)AL_DISK_HEADER_ADDRESS;
+		*length = di_align_len(AL_DISK_HEADER_SIZE);
 		*offset = 0;
 		invalidate_dcache_range(*address, *address + *length);
 
 		al_control.step++;
 		break;
 	case 6:
-		/* boot.bin and bi2.bin header loaded */
+		/* boot.bin and bi2.bin loaded */
 
-		disk_header = (struct gcm_disk_header *)di_buffer;
-		disk_header_info = (struct gcm_disk_header_info *)(di_buffer + sizeof(*disk_header));
+		disk_header = (struct gcm_disk_header *)AL_DISK_HEADER_ADDRESS;
+		be32_to_cpus(&disk_header->layout.fst_offset);
+		be32_to_cpus(&disk_header->layout.fst_size);
 
 		al_control.fst_offset = disk_header->layout.fst_offset;
 		al_control.fst_size = disk_header->layout.fst_size;
 		al_control.fst_address = (0x81800000 - al_control.fst_size) & DI_ALIGN_MASK;
+		al_control.bi2_address = al_control.fst_address - 0x2000;
 
-		/* read fst.bin */
-		*address = (void *)al_control.fst_address;
-		*length = (uint32_t) di_align(al_control.fst_size);
-		*offset = al_control.fst_offset;
-		invalidate_dcache_range(*address, *address + *length);
+		/*
+		 * Move bi2.bin right below fst.bin, no need to read it again.
+		 * It only moves down, over the disk header it was read with.
+		 */
+		memmove((void *)al_control.bi2_address, disk_header + 1, 0x2000);
+		flush_dcache_range((void *)al_control.bi2_address,
+				   (void *)al_control.bi2_address + 0x2000);
 
 		al_control.step++;
-		break;
+
+		if (al_control.fst_size) {
+			/* read fst.bin */
+			*address = (void *)al_control.fst_address;
+			*length = di_align_len(al_control.fst_size);
+			*offset = al_control.fst_offset;
+			invalidate_dcache_range(*address, *address + *length);
+			break;
+		}
+		/* no fst.bin, we are done */
+		/* fall through */
 	case 7:
 		/* fst.bin loaded */
 
-		al_control.bi2_address = al_control.fst_address - 0x2000;
-
-		/* read bi2.bin */
-		*address = (void *)al_control.bi2_address;
-		*length = 0x2000;
-		*offset = 0x440;
-		invalidate_dcache_range(*address, *address + *length);
-
-		al_control.step++;
-		break;
-	case 8:
-		/* bi2.bin loaded */
-
 		lowmem->a_boot_magic = 0x0d15ea5e;
 		lowmem->a_version = 1;
 
@@ -526,6 +635,14 @@ static int al_load(void **address, uint32_t *length, uint32_t *offset)
  */
 static void *al_exit(void)
 {
+	trace_event(BOOT_TRACE_AL_EXIT, 0);
+	trace_flush();
+
+	dbg_printf("al: entry point %p\n", bl_control.entry_point);
+#ifdef DEBUG
+	gcn_con_exit();
+#endif
+
 #if RESET_DVD
 	writel((readl(FLIPPER_RESET) & ~FLIPPER_RESET_DVD) | 1, FLIPPER_RESET);
 #endif
@@ -13,52 +13,257 @@
 
 #ifdef DEBUG
 
+#include <stdarg.h>
+
 #include "../include/debug.h"
 #include "../include/system.h"
 
+#define DBG_PRINTF_BUF_SIZE	256
+
+/* "xxxxxxxx: " + 16 * "xx " + "\n" */
+#define DBG_DUMP_LINE_SIZE	(8 + 2 + 16 * 3 + 1)
+#define DBG_DUMP_LINES		16
+
 static const char digits[] = "0123456789abcdef";
+static const char upper_digits[] = "0123456789ABCDEF";
+
+struct dbg_buf {
+	char *p, *end;
+};
+
+static inline void dbg_buf_putc(struct dbg_buf *b, char c)
+{
+	if (b->p < b->end)
+		*b->p = c;
+	b->p++;
+}
+
+static void dbg_buf_pad(struct dbg_buf *b, char c, int count)
+{
+	while (count-- > 0)
+		dbg_buf_putc(b, c);
+}
+
+/*
+ * Formats an unsigned number right to left into a scratch area.
+ * Returns the number of digits.
+ */
+static int format_number(char *tmp, unsigned long val, unsigned base,
+			 const char *set)
+{
+	int len = 0;
+
+	do {
+		tmp[len++] = set[val % base];
+		val /= base;
+	} while (val);
+	return len;
+}
+
+/*
+ * A small vsnprintf.
+ * Supports the '0' and '-' flags, field width, the 'l' and 'h' length
+ * modifiers, and the c, s, d, i, u, x, X and p conversions.
+ * Returns the length the formatted string would have had.
+ */
+int dbg_vsnprintf(char *buf, int size, const char *fmt, va_list args)
+{
+	struct dbg_buf b = { .p = buf, .end = buf + size - 1 };
+	char tmp[12];
+	const char *s;
+	unsigned long val;
+	int width, len, left, negative, is_long;
+	char fill;
+
+	if (size <= 0)
+		b.end = buf;
+
+	for (; *fmt; fmt++) {
+		if (*fmt != '%') {
+			dbg_buf_putc(&b, *fmt);
+			continue;
+		}
+
+		fmt++;
+		left = 0;
+		fill = ' ';
+		for (;; fmt++) {
+			if (*fmt == '-')
+				left = 1;
+			else if (*fmt == '0')
+				fill = '0';
+			else
+				break;
+		}
+		width = 0;
+		while (*fmt >= '0' && *fmt <= '9')
+			width = width * 10 + (*fmt++ - '0');
+		is_long = 0;
+		while (*fmt == 'l' || *fmt == 'h')
+			is_long = (*fmt++ == 'l');
+		if (left)
+			fill = ' ';
 
-static void dump_byte(unsigned char data)
+		negative = 0;
+		switch (*fmt) {
+		case 'c':
+			dbg_buf_pad(&b, ' ', left ? 0 : width - 1);
+			dbg_buf_putc(&b, (char)va_arg(args, int));
+			dbg_buf_pad(&b, ' ', left ? width - 1 : 0);
+			continue;
+		case 's':
+			s = va_arg(args, const char *);
+			if (!s)
+				s = "(null)";
+			for (len = 0; s[len]; len++)
+				;
+			dbg_buf_pad(&b, ' ', left ? 0 : width - len);
+			while (*s)
+				dbg_buf_putc(&b, *s++);
+			dbg_buf_pad(&b, ' ', left ? width - len : 0);
+			continue;
+		case 'd':
+		case 'i':
+			val = is_long ? va_arg(args, long) : va_arg(args, int);
+			if ((long)val < 0) {
+				negative = 1;
+				val = -(long)val;
+			}
+			len = format_number(tmp, val, 10, digits);
+			break;
+		case 'u':
+			val = is_long ? va_arg(args, unsigned long) :
+					va_arg(args, unsigned int);
+			len = format_number(tmp, val, 10, digits);
+			break;
+		case 'p':
+			dbg_buf_putc(&b, '0');
+			dbg_buf_putc(&b, 'x');
+			fill = '0';
+			width = 8;
+			left = 0;
+			val = (unsigned long)va_arg(args, void *);
+			len = format_number(tmp, val, 16, digits);
+			break;
+		case 'x':
+		case 'X':
+			val = is_long ? va_arg(args, unsigned long) :
+					va_arg(args, unsigned int);
+			len = format_number(tmp, val, 16,
+					    (*fmt == 'x') ? digits : upper_digits);
+			break;
+		case '%':
+			dbg_buf_putc(&b, '%');
+			continue;
+		case '\0':
+			fmt--;
+			continue;
+		default:
+			dbg_buf_putc(&b, '%');
+			dbg_buf_putc(&b, *fmt);
+			continue;
+		}
+
+		width -= len + negative;
+		if (!left && fill == ' ')
+			dbg_buf_pad(&b, ' ', width);
+		if (negative)
+			dbg_buf_putc(&b, '-');
+		if (!left && fill == '0')
+			dbg_buf_pad(&b, '0', width);
+		while (len > 0)
+			dbg_buf_putc(&b, tmp[--len]);
+		if (left)
+			dbg_buf_pad(&b, ' ', width);
+	}
+
+	if (size > 0)
+		*(b.p < b.end ? b.p : b.end) = '\0';
+
+	return b.p - buf;
+}
+
+int dbg_snprintf(char *buf, int size, const char *fmt, ...)
 {
-	gcn_con_putc(digits[(data & 0xf0) >> 4]);
-	gcn_con_putc(digits[data & 0x0f]);
+	va_list args;
+	int len;
+
+	va_start(args, fmt);
+	len = dbg_vsnprintf(buf, size, fmt, args);
+	va_end(args);
+	return len;
 }
 
+/*
+ * Formats into a stack buffer and hands it to the console in one go.
+ * Output longer than DBG_PRINTF_BUF_SIZE-1 chars is truncated.
+ */
+int dbg_printf(const char *fmt, ...)
+{
+	char buf[DBG_PRINTF_BUF_SIZE];
+	va_list args;
+	int len;
+
+	va_start(args, fmt);
+	len = dbg_vsnprintf(buf, sizeof(buf), fmt, args);
+	va_end(args);
+
+	gcn_con_puts(buf);
+	return len;
+}
+
+/*
+ * Dumps memory in hex, 16 bytes per line.
+ * Up to DBG_DUMP_LINES lines are sent to the console at once, so a whole
+ * DOL header takes a single console update.
+ */
 void dbg_dump_memory(void *mem, int size)
 {
-	int chunk;
+	char buf[DBG_DUMP_LINES * DBG_DUMP_LINE_SIZE + 1];
+	unsigned char *p = mem;
+	int chunk, len = 0;
 
 	while (size > 0) {
-		dump_byte((((unsigned long)mem) & 0xff000000) >> 24);
-		dump_byte((((unsigned long)mem) & 0x00ff0000) >> 16);
-		dump_byte((((unsigned long)mem) & 0x0000ff00) >> 8);
-		dump_byte((((unsigned long)mem) & 0x000000ff));
-		gcn_con_putc(':');
-		gcn_con_putc(' ');
+		len += dbg_snprintf(buf + len, sizeof(buf) - len, "%08lx: ",
+				    (unsigned long)p);
 		chunk = (size > 16) ? 16 : size;
 		size -= chunk;
 		while (chunk) {
-			dump_byte(*(unsigned char *)mem);
-			gcn_con_putc(' ');
-			mem++;
+			buf[len++] = digits[*p >> 4];
+			buf[len++] = digits[*p & 0x0f];
+			buf[len++] = ' ';
+			p++;
 			chunk--;
 		}
-		gcn_con_putc('\n');
+		buf[len++] = '\n';
+
+		/* flush when another line might not fit */
+		if (sizeof(buf) - len <= DBG_DUMP_LINE_SIZE || size <= 0) {
+			buf[len] = '\0';
+			gcn_con_puts(buf);
+			len = 0;
+		}
 	}
 }
 
+/*
+ * Prints memory as a single hex number, in one console update.
+ * Longer areas are printed in DBG_PRINTF_BUF_SIZE/2 byte pieces.
+ */
 void dbg_print_val(void *mem, int size)
 {
-	int chunk;
+	char buf[DBG_PRINTF_BUF_SIZE + 1];
+	unsigned char *p = mem;
+	int len;
 
 	while (size > 0) {
-		chunk = (size > 16) ? 16 : size;
-		size -= chunk;
-		while (chunk) {
-			dump_byte(*(unsigned char *)mem);
-			mem++;
-			chunk--;
+		for (len = 0; size > 0 && len < DBG_PRINTF_BUF_SIZE;
+		     size--, p++) {
+			buf[len++] = digits[*p >> 4];
+			buf[len++] = digits[*p & 0x0f];
 		}
+		buf[len] = '\0';
+		gcn_con_puts(buf);
 	}
 }
 
@@ -29,6 +29,10 @@ void gcn_con_putc(char c)
 {
 }
 
+void gcn_con_flush(void)
+{
+}
+
 void gcn_con_init(void)
 {
 }
@@ -4671,6 +4675,12 @@ struct console_data_s {
 	int border_left, border_right, border_top, border_bottom;
 
 	int scrolled_lines;
+
+	/* framebuffer area pending write back, in bytes x lines */
+	int dirty_x0, dirty_y0, dirty_x1, dirty_y1;
+
+	/* framebuffer words for each possible font row */
+	unsigned long glyph_rows[256][FONT_XSIZE * FONT_XFACTOR / 2];
 };
 
 static struct console_data_s *default_console = (struct console_data_s *)-1;
@@ -4693,49 +4703,209 @@ static const unsigned long VIDEO_Mode640X480Pal60YUV16[32] = {
 
 void gcn_con_init(void);
 
-static void console_drawc(struct console_data_s *con, int x, int y,
-			  unsigned char c)
+#define GLYPH_WIDTH_BYTES	(FONT_XSIZE * FONT_XFACTOR * 2)
+#define GLYPH_ROW_WORDS		(GLYPH_WIDTH_BYTES / 4)
+#define GLYPH_HEIGHT		(FONT_YSIZE * FONT_YFACTOR)
+
+/*
+ * Grows the pending write back area to include the given rectangle.
+ */
+static void console_mark_dirty(struct console_data_s *con,
+			       int x0, int y0, int x1, int y1)
 {
-	x >>= 1;
-	int ax, ay;
-	unsigned long *ptr =
-	    (unsigned long *)(con->framebuffer + con->stride * y + x * 4);
-	for (ay = 0; ay < FONT_YSIZE; ay++) {
+	if (x0 < con->dirty_x0)
+		con->dirty_x0 = x0;
+	if (y0 < con->dirty_y0)
+		con->dirty_y0 = y0;
+	if (x1 > con->dirty_x1)
+		con->dirty_x1 = x1;
+	if (y1 > con->dirty_y1)
+		con->dirty_y1 = y1;
+}
+
+static void console_clear_dirty(struct console_data_s *con)
+{
+	con->dirty_x0 = con->stride;
+	con->dirty_y0 = con->yres;
+	con->dirty_x1 = 0;
+	con->dirty_y1 = 0;
+}
+
+/*
+ * Writes back framebuffer lines [y0, y1) of both screen copies.
+ */
+static void console_flush_lines(struct console_data_s *con, int y0, int y1)
+{
+	unsigned char *line, *mirror;
+	int y;
+
+	line = con->framebuffer + con->stride * y0;
+	mirror = line + con->stride * con->yres;
+	if (con->dirty_x0 == 0 && con->dirty_x1 == con->stride) {
+		/* full lines are contiguous, do them in one go */
+		flush_dcache_range(line, line + con->stride * (y1 - y0));
+		flush_dcache_range(mirror, mirror + con->stride * (y1 - y0));
+	} else {
+		for (y = y0; y < y1; y++) {
+			flush_dcache_range(line + con->dirty_x0,
+					   line + con->dirty_x1);
+			flush_dcache_range(mirror + con->dirty_x0,
+					   mirror + con->dirty_x1);
+			line += con->stride;
+			mirror += con->stride;
+		}
+	}
+}
+
+/*
+ * Writes back to memory only the cache lines touched since last flush.
+ */
+static void console_flush(struct console_data_s *con)
+{
+	int y0, y1;
+
+	if (con->dirty_x0 >= con->dirty_x1 || con->dirty_y0 >= con->dirty_y1)
+		return;
+
+	y0 = con->dirty_y0 + con->scrolled_lines;
+	y1 = con->dirty_y1 + con->scrolled_lines;
+	if (y0 >= con->yres) {
+		y0 -= con->yres;
+		y1 -= con->yres;
+	}
+	if (y1 > con->yres) {
+		/* dirty area wraps around the end of the screen copy */
+		console_flush_lines(con, y0, con->yres);
+		console_flush_lines(con, 0, y1 - con->yres);
+	} else {
+		console_flush_lines(con, y0, y1);
+	}
+
+	console_clear_dirty(con);
+}
+
+/*
+ * Returns the framebuffer line currently holding the given screen line.
+ * Text lines never straddle the end of a screen copy, as yres is a
+ * multiple of the text line height.
+ */
+static inline int console_line(struct console_data_s *con, int y)
+{
+	y += con->scrolled_lines;
+	if (y >= con->yres)
+		y -= con->yres;
+	return y;
+}
+
+/*
+ * Sets the console colours and rebuilds the glyph row expansion table.
+ *
+ * Each entry holds the framebuffer words for one 8 pixel font row, so
+ * drawing a glyph becomes a sequence of plain word copies.
+ */
+static void console_set_colors(struct console_data_s *con,
+			       int foreground, int background)
+{
+	unsigned long *words;
+	int bits, ax;
+
+	con->foreground = foreground;
+	con->background = background;
+
+	for (bits = 0; bits < 256; bits++) {
+		words = con->glyph_rows[bits];
 #if FONT_XFACTOR == 2
+		/* pixel doubling: one font pixel per word */
 		for (ax = 0; ax < 8; ax++) {
-			unsigned long color;
-			if ((con->font[c * FONT_YSIZE + ay] << ax) & 0x80)
-				color = con->foreground;
+			if ((bits << ax) & 0x80)
+				words[ax] = foreground;
 			else
-				color = con->background;
-#if FONT_YFACTOR == 2
-			// pixel doubling: we write u32
-			ptr[ay * 2 * con->stride / 4 + ax] = color;
-			// line doubling
-			ptr[(ay * 2 + 1) * con->stride / 4 + ax] = color;
-#else
-			ptr[ay * con->stride / 4 + ax] = color;
-#endif
+				words[ax] = background;
 		}
 #else
+		/* two font pixels per word, Y0 U Y1 V */
 		for (ax = 0; ax < 4; ax++) {
 			unsigned long color[2];
-			int bits = (con->font[c * FONT_YSIZE + ay] << (ax * 2));
-			if (bits & 0x80)
-				color[0] = con->foreground;
-			else
-				color[0] = con->background;
-			if (bits & 0x40)
-				color[1] = con->foreground;
-			else
-				color[1] = con->background;
-			ptr[ay * con->stride / 4 + ax] =
-			    (color[0] & 0xFFFF00FF) | (color[1] & 0x0000FF00);
+			color[0] = ((bits << (ax * 2)) & 0x80) ?
+					foreground : background;
+			color[1] = ((bits << (ax * 2)) & 0x40) ?
+					foreground : background;
+			words[ax] = (color[0] & 0xFFFF00FF) |
+				    (color[1] & 0x0000FF00);
 		}
 #endif
 	}
 }
 
+static void console_drawc(struct console_data_s *con, int x, int y,
+			  unsigned char c)
+{
+	x >>= 1;
+	int ax, ay;
+	const unsigned char *glyph = con->font + c * FONT_YSIZE;
+	const unsigned long *words;
+	unsigned long *ptr =
+	    (unsigned long *)(con->framebuffer +
+			      con->stride * console_line(con, y) + x * 4);
+	int mirror = con->stride * con->yres / 4;
+	for (ay = 0; ay < GLYPH_HEIGHT; ay++) {
+		words = con->glyph_rows[glyph[ay / FONT_YFACTOR]];
+		for (ax = 0; ax < GLYPH_ROW_WORDS; ax++)
+			ptr[ax] = ptr[ax + mirror] = words[ax];
+		ptr += con->stride / 4;
+	}
+
+	console_mark_dirty(con, x * 4, y, x * 4 + GLYPH_WIDTH_BYTES,
+			   y + GLYPH_HEIGHT);
+}
+
+/*
+ * Points the video interface to the first visible framebuffer line.
+ */
+static void console_set_base(struct console_data_s *con)
+{
+	unsigned long base = virt_to_phys(con->framebuffer) +
+			     con->stride * con->scrolled_lines;
+
+	writel(base, GCN_VI_TFBL);
+	writel(base + con->stride, GCN_VI_BFBL);
+}
+
+/*
+ * Scrolls up one text line by moving the video base address.
+ *
+ * The framebuffer holds two copies of the screen, one after another, so
+ * any yres consecutive lines starting within the first copy make up a
+ * complete screen. Only the newly exposed text line needs to be cleared.
+ */
+static void console_scroll(struct console_data_s *con)
+{
+	int height = FONT_YSIZE * FONT_YFACTOR + FONT_YGAP;
+	int cnt = (con->stride * height) / 4;
+	unsigned long *ptr;
+	int mirror = con->stride * con->yres / 4;
+
+	/* write back what was drawn using the old line mapping */
+	console_flush(con);
+
+	con->scrolled_lines += height;
+	if (con->scrolled_lines >= con->yres)
+		con->scrolled_lines -= con->yres;
+
+	ptr = (unsigned long *)(con->framebuffer + con->stride *
+				console_line(con, con->yres - height));
+	while (cnt--) {
+		ptr[mirror] = con->background;
+		*ptr++ = con->background;
+	}
+	con->cursor_y -= height;
+
+	console_mark_dirty(con, 0, con->yres - height, con->stride, con->yres);
+	console_flush(con);
+
+	console_set_base(con);
+}
+
 static void console_putc(struct console_data_s *con, char c)
 {
 	switch (c) {
@@ -4753,29 +4923,15 @@ static void console_putc(struct console_data_s *con, char c)
 			con->cursor_x = con->border_left;
 		}
 	}
-	if ((con->cursor_y + FONT_YSIZE * FONT_YFACTOR) >= con->border_bottom) {
-		memcpy(con->framebuffer,
-		       con->framebuffer +
-		       con->stride * (FONT_YSIZE * FONT_YFACTOR + FONT_YGAP),
-		       con->stride * con->yres - FONT_YSIZE);
-		int cnt =
-		    (con->stride * (FONT_YSIZE * FONT_YFACTOR + FONT_YGAP)) / 4;
-		unsigned long *ptr =
-		    (unsigned long *)(con->framebuffer +
-				      con->stride * (con->yres - FONT_YSIZE));
-		while (cnt--)
-			*ptr++ = con->background;
-		con->cursor_y -= FONT_YSIZE * FONT_YFACTOR + FONT_YGAP;
-	}
-
-	flush_dcache_range(con->framebuffer,
-			   (con->framebuffer + con->stride * con->yres));
+	if ((con->cursor_y + FONT_YSIZE * FONT_YFACTOR) >= con->border_bottom)
+		console_scroll(con);
 }
 
 static void console_puts(struct console_data_s *con, const char *string)
 {
 	while (*string)
 		console_putc(con, *string++);
+	console_flush(con);
 }
 
 static void console_init(struct console_data_s *con, void *framebuffer,
@@ -4796,18 +4952,22 @@ static void console_init(struct console_data_s *con, void *framebuffer,
 
 	con->font = fontdata_8x16;
 
-	con->foreground = COLOR_BLACK;
-	con->background = COLOR_WHITE;
+	console_set_colors(con, COLOR_BLACK, COLOR_WHITE);
 
 	con->scrolled_lines = 0;
 
-	c = (con->xres / 2) * con->yres;
+	console_clear_dirty(con);
+
+	/* clear both screen copies */
+	c = (con->xres / 2) * con->yres * 2;
 	p = (unsigned long *)con->framebuffer;
 	while (c--)
 		*p++ = con->background;
 
 	flush_dcache_range(con->framebuffer,
-			   (con->framebuffer + con->stride * con->yres));
+			   (con->framebuffer + con->stride * con->yres * 2));
+
+	console_set_base(con);
 
 	default_console = con;
 }
@@ -4828,6 +4988,15 @@ void gcn_con_puts(const char *s)
 void gcn_con_putc(char c)
 {
 	console_putc(default_console, c);
+	console_flush(default_console);
+}
+
+/**
+ *
+ */
+void gcn_con_flush(void)
+{
+	console_flush(default_console);
 }
 
 /**
@@ -4854,9 +5023,8 @@ void gcn_con_init(void)
 
 	//writel(0x10000000 | (GCN_XFB_START>>5), GCN_VI_TFBL);
 	//writel(0x10000000 | ((GCN_XFB_START+2*640)>>5), GCN_VI_BFBL);
-	writel(GCN_XFB_START, GCN_VI_TFBL);
-	writel(GCN_XFB_START + 2 * 640, GCN_VI_BFBL);
 
+	/* video base addresses are set by console_init() */
 	console_init(&gcn_con_data, (void *)(0x80000000 | GCN_XFB_START),
 		     640, GCN_VIDEO_LINES, 640 * 2);
 
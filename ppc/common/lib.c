@@ -13,15 +13,157 @@
 
 #include "../include/system.h"
 
+#define L1_CACHE_LINE_MASK	(L1_CACHE_LINE_SIZE - 1)
+#define WORDS_PER_LINE		(L1_CACHE_LINE_SIZE / 4)
+
+#ifdef HOST_SIM
+
+/*
+ * Host builds (see ppc/test) zero the whole line, like the real thing,
+ * so misuses of dcbz show up there too.
+ */
+static inline void dcbz(void *addr)
+{
+	volatile uint32_t *line;
+	int i;
+
+	line = (uint32_t *)((unsigned long)addr & ~L1_CACHE_LINE_MASK);
+	for (i = 0; i < WORDS_PER_LINE; i++)
+		line[i] = 0;
+}
+
+#else
+
+/*
+ * Zeroes a whole data cache line without reading it from memory first.
+ * Only valid on cacheable memory.
+ */
+static inline void dcbz(void *addr)
+{
+	asm volatile ("dcbz 0,%0" : : "r" (addr) : "memory");
+}
+
+#endif /* HOST_SIM */
+
+/*
+ * dcbz raises an alignment exception on cache-inhibited memory, so
+ * restrict its use to the cached RAM mapping.
+ */
+static inline int is_cached_ram(void *addr)
+{
+	return ((unsigned long)addr & 0xc0000000) == 0x80000000;
+}
+
 void *memcpy(void *dest, const void *src, int count)
 {
 	char *tmp = (char *)dest, *s = (char *)src;
+	uint32_t *d32, *s32;
+	int zero_lines;
+
+	/* word accesses are only possible if both sides align together */
+	if ((((unsigned long)tmp ^ (unsigned long)s) & 3) == 0) {
+		/* unaligned head */
+		while (count > 0 && ((unsigned long)tmp & 3)) {
+			*tmp++ = *s++;
+			count--;
+		}
+
+		d32 = (uint32_t *)tmp;
+		s32 = (uint32_t *)s;
 
-	while (count--)
+		if (count >= 2 * L1_CACHE_LINE_SIZE) {
+			/* words up to the next destination cache line */
+			while ((unsigned long)d32 & L1_CACHE_LINE_MASK) {
+				*d32++ = *s32++;
+				count -= 4;
+			}
+
+			/*
+			 * Whole lines. Destination lines are going to be fully
+			 * overwritten, so establish them in the cache with dcbz
+			 * instead of fetching them from memory.
+			 */
+			zero_lines = is_cached_ram(d32);
+			while (count >= L1_CACHE_LINE_SIZE) {
+				if (zero_lines)
+					dcbz(d32);
+				d32[0] = s32[0];
+				d32[1] = s32[1];
+				d32[2] = s32[2];
+				d32[3] = s32[3];
+				d32[4] = s32[4];
+				d32[5] = s32[5];
+				d32[6] = s32[6];
+				d32[7] = s32[7];
+				d32 += WORDS_PER_LINE;
+				s32 += WORDS_PER_LINE;
+				count -= L1_CACHE_LINE_SIZE;
+			}
+		}
+
+		/* remaining words */
+		while (count >= 4) {
+			*d32++ = *s32++;
+			count -= 4;
+		}
+
+		tmp = (char *)d32;
+		s = (char *)s32;
+	}
+
+	/* unaligned tail, or mutually misaligned buffers */
+	while (count-- > 0)
 		*tmp++ = *s++;
 	return dest;
 }
 
+/*
+ * memcpy for buffers which may overlap.
+ */
+void *memmove(void *dest, const void *src, int count)
+{
+	char *tmp = (char *)dest, *s = (char *)src;
+	uint32_t *d32, *s32;
+
+	if (tmp <= s) {
+		/*
+		 * Copying forwards only overwrites bytes already read,
+		 * unless memcpy's dcbz gets ahead of the source.
+		 */
+		if (tmp + count <= s || s - tmp >= L1_CACHE_LINE_SIZE)
+			return memcpy(dest, src, count);
+		while (count-- > 0)
+			*tmp++ = *s++;
+		return dest;
+	}
+	if (s + count <= tmp)
+		return memcpy(dest, src, count);
+
+	/* destination overlaps the end of the source, copy backwards */
+	tmp += count;
+	s += count;
+	if ((((unsigned long)tmp ^ (unsigned long)s) & 3) == 0) {
+		while (count > 0 && ((unsigned long)tmp & 3)) {
+			*--tmp = *--s;
+			count--;
+		}
+
+		d32 = (uint32_t *)tmp;
+		s32 = (uint32_t *)s;
+		while (count >= 4) {
+			*--d32 = *--s32;
+			count -= 4;
+		}
+
+		tmp = (char *)d32;
+		s = (char *)s32;
+	}
+
+	while (count-- > 0)
+		*--tmp = *--s;
+	return dest;
+}
+
 int memcmp(const void *cs, const void *ct, int count)
 {
 	const unsigned char *su1, *su2;
@@ -36,8 +178,59 @@ int memcmp(const void *cs, const void *ct, int count)
 void *memset(void *s, int c, int count)
 {
 	char *xs = (char *)s;
+	uint32_t *x32;
+	uint32_t word;
+
+	/* unaligned head */
+	while (count > 0 && ((unsigned long)xs & 3)) {
+		*xs++ = c;
+		count--;
+	}
+
+	x32 = (uint32_t *)xs;
+	word = c & 0xff;
+	word |= word << 8;
+	word |= word << 16;
+
+	if (count >= 2 * L1_CACHE_LINE_SIZE) {
+		/* words up to the next cache line */
+		while ((unsigned long)x32 & L1_CACHE_LINE_MASK) {
+			*x32++ = word;
+			count -= 4;
+		}
+
+		if (word == 0 && is_cached_ram(x32)) {
+			/* zero whole lines without touching memory */
+			while (count >= L1_CACHE_LINE_SIZE) {
+				dcbz(x32);
+				x32 += WORDS_PER_LINE;
+				count -= L1_CACHE_LINE_SIZE;
+			}
+		} else {
+			while (count >= L1_CACHE_LINE_SIZE) {
+				x32[0] = word;
+				x32[1] = word;
+				x32[2] = word;
+				x32[3] = word;
+				x32[4] = word;
+				x32[5] = word;
+				x32[6] = word;
+				x32[7] = word;
+				x32 += WORDS_PER_LINE;
+				count -= L1_CACHE_LINE_SIZE;
+			}
+		}
+	}
+
+	/* remaining words */
+	while (count >= 4) {
+		*x32++ = word;
+		count -= 4;
+	}
 
-	while (count--)
+	/* unaligned tail */
+	xs = (char *)x32;
+	while (count-- > 0)
 		*xs++ = c;
 
 	return s;
@@ -26,6 +26,14 @@ extern void dbg_dump_memory(void *mem, int size);
 
 extern void dbg_print_val(void *mem, int size);
 
+#include <stdarg.h>
+
+extern int dbg_vsnprintf(char *buf, int size, const char *fmt, va_list args);
+extern int dbg_snprintf(char *buf, int size, const char *fmt, ...)
+	__attribute__ ((format (printf, 3, 4)));
+extern int dbg_printf(const char *fmt, ...)
+	__attribute__ ((format (printf, 1, 2)));
+
 #else
 
 #define dbg_rumble(enable)		do {} while(0)
@@ -36,6 +44,8 @@ extern void dbg_print_val(void *mem, int size);
 
 #define dbg_print_val(mem, size)	do {} while(0)
 
+#define dbg_printf(fmt, ...)		do {} while(0)
+
 #endif
 
 #endif /* __DEBUG_H */
@@ -16,5 +16,6 @@ extern void gcn_con_exit(void);
 
 extern void gcn_con_puts(const char *s);
 extern void gcn_con_putc(char c);
+extern void gcn_con_flush(void);
 
 #endif /* __GCN_CON_H */
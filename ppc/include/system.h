@@ -21,7 +21,8 @@
 #define GCN_RAM_SIZE		(24*1024*1024)
 #define GCN_TOP_OF_RAM		(0x01200000)	/* up to apploader code */
 
-#define GCN_XFB_SIZE		(2*640*GCN_VIDEO_LINES)
+/* two screen copies, the console scrolls by moving the video base */
+#define GCN_XFB_SIZE		(2*2*640*GCN_VIDEO_LINES)
 
 //#define GCN_XFB_END             (GCN_TOP_OF_RAM-1)
 //#define GCN_XFB_START           (GCN_XFB_END-GCN_XFB_SIZE+1)
@@ -59,6 +60,28 @@
 #define le16_to_cpus(addr) st_le16(addr, *addr)
 #define le32_to_cpus(addr) st_le32(addr, *addr)
 
+#ifdef HOST_SIM
+
+/*
+ * Host builds (see alsim) run on little endian machines.
+ */
+
+#define be32_to_cpus(addr) (*(addr) = __builtin_bswap32(*(addr)))
+
+static inline void st_le16(volatile uint16_t * addr, const uint16_t val)
+{
+	*addr = val;
+}
+
+static inline void st_le32(volatile uint32_t * addr, const uint32_t val)
+{
+	*addr = val;
+}
+
+#else
+
+#define be32_to_cpus(addr) do {} while (0)
+
 static inline void st_le16(volatile uint16_t * addr, const uint16_t val)
 {
 	asm volatile ("sthbrx %1,0,%2":"=m" (*addr):"r"(val), "r"(addr));
@@ -69,6 +92,13 @@ static inline void st_le32(volatile uint32_t * addr, const uint32_t val)
 	asm volatile ("stwbrx %1,0,%2":"=m" (*addr):"r"(val), "r"(addr));
 }
 
+#endif /* HOST_SIM */
+
+#ifdef HOST_SIM
+/* there are no hardware registers on the host, the test program fakes them */
+extern unsigned long readl(volatile void *addr);
+extern void writel(unsigned long b, volatile void *addr);
+#else
 static inline unsigned long readl(volatile void *addr)
 {
 	return *(volatile unsigned long *)(addr);
@@ -78,7 +108,16 @@ static inline void writel(unsigned long b, volatile void *addr)
 {
 	*(volatile unsigned long *)(addr) = b;
 }
+#endif
+
+static inline unsigned long virt_to_phys(volatile void *addr)
+{
+	return (unsigned long)addr & 0x3fffffff;
+}
 
+#ifdef HOST_SIM
+extern unsigned long ticks(void);
+#else
 static inline unsigned long ticks(void)
 {
 	unsigned long tbl;
@@ -86,10 +125,12 @@ static inline unsigned long ticks(void)
 	asm volatile ("mftb %0" : "=r" (tbl));
 	return tbl;
 }
+#endif
 
 extern void flush_dcache_range(void *start, void *stop);
 extern void invalidate_dcache_range(void *start, void *stop);
 extern void invalidate_icache_range(void *start, void *stop);
+extern void flush_icache_range(void *start, void *stop);
 
 extern void rumble(int enable);
 extern void rumble_on(void);
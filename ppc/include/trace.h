@@ -0,0 +1,104 @@
+/*
+ * trace.h
+ *
+ * Copyright (C) 2005-2006 The GameCube Linux Team
+ * Copyright (C) 2005,2006 Albert Herranz
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ */
+
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#ifndef BOOT_TRACE
+#define BOOT_TRACE 1
+#endif
+
+#if BOOT_TRACE
+
+#include "system.h"
+
+#include "../../include/boottrace.h"
+
+#define boot_trace ((struct boot_trace *)BOOT_TRACE_ADDRESS)
+
+/*
+ * Cleared once the ring may be overwritten by the payload, one per stage.
+ * Kept in .data, the .bss is neither loaded nor cleared, and being small
+ * it would otherwise go to .sdata.
+ */
+static int trace_enabled __attribute__ ((section(".data"))) = 1;
+
+/*
+ * Starts a new trace, discarding whatever was there.
+ */
+static inline void trace_init(void)
+{
+	boot_trace->magic = BOOT_TRACE_MAGIC;
+	boot_trace->head = 0;
+	boot_trace->nr_records = BOOT_TRACE_RECORDS;
+	boot_trace->ticks_per_sec = BOOT_TRACE_TICKS_PER_SEC;
+}
+
+/*
+ * Continues the trace of a previous boot stage, or starts a new one.
+ */
+static inline void trace_attach(void)
+{
+	if (boot_trace->magic != BOOT_TRACE_MAGIC ||
+	    boot_trace->nr_records != BOOT_TRACE_RECORDS)
+		trace_init();
+}
+
+/*
+ * Records an event. Two stores and a timebase read, cheap enough to be
+ * always enabled.
+ */
+static inline void trace_event(unsigned int id, unsigned int arg)
+{
+	struct boot_trace_record *record;
+
+	if (!trace_enabled)
+		return;
+
+	record = &boot_trace->records[boot_trace->head++ &
+				      (BOOT_TRACE_RECORDS - 1)];
+	record->ticks = ticks();
+	record->event = BOOT_TRACE_EVENT(id, arg);
+}
+
+/*
+ * Writes the trace back to memory, so it survives in a memory dump.
+ */
+static inline void trace_flush(void)
+{
+	if (trace_enabled)
+		flush_dcache_range(boot_trace, boot_trace + 1);
+}
+
+/*
+ * Stops tracing for good if the given memory area overlaps the ring.
+ * Must be called for every area we are about to load something into.
+ */
+static inline void trace_reserve(unsigned long start, unsigned long end)
+{
+	if (start < (unsigned long)(boot_trace + 1) &&
+	    end > (unsigned long)boot_trace)
+		trace_enabled = 0;
+}
+
+#else
+
+#define trace_init()		do {} while(0)
+#define trace_attach()		do {} while(0)
+#define trace_event(id, arg)	do {} while(0)
+#define trace_flush()		do {} while(0)
+#define trace_reserve(start, end)	do {} while(0)
+
+#endif /* BOOT_TRACE */
+
+#endif /* __TRACE_H */
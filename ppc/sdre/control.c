@@ -5,5 +5,10 @@
 
 #include "../../include/dolrel.h"
 
-struct dolrel_control __dolrel_control = { .version = 0xdead0001, };
+extern char _end[];
+
+struct dolrel_control __dolrel_control = {
+	.version = DOLREL_VERSION,
+	.engine_end = _end,
+};
 
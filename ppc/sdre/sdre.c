@@ -16,13 +16,21 @@
 
 #include "../include/system.h"
 #include "../include/debug.h"
+#include "../include/trace.h"
 
 #include "../../include/dolrel.h"
+#include "../../include/lz.h"
 
 
+#ifdef HOST_SIM
+/* host builds, see ppc/test/ditest.c */
+#define mtmsr(v)        ((void)(v))
+#define mfmsr()         0UL
+#else
 #define mtmsr(v)        asm volatile("mtmsr %0" : : "r" (v))
 #define mfmsr()         ({unsigned long rval; \
                         asm volatile("mfmsr %0" : "=r" (rval)); rval;})
+#endif
 
 #define __MASK(X)       (1UL<<(X))
 
@@ -109,20 +117,45 @@ static inline void local_irq_disable(void)
 #define CMDBUF(a,b,c,d) (((a)<<24)|((b)<<16)|((c)<<8)|(d))
 
 
+/* the timebase runs at a quarter of the 162MHz bus clock */
+#define TB_TICKS_PER_MSEC	(162000 / 4)
+
+#define msecs_to_ticks(msecs)	((msecs) * TB_TICKS_PER_MSEC)
+
+/* how long the DVD unit is held in reset */
+#define DI_RESET_HOLD_MSECS	1
+
+/* how long we wait for the drive to accept commands after a reset */
+#define DI_RESET_TIMEOUT_MSECS	2000
+
+/* how long a single drive command may take */
+#define DI_COMMAND_TIMEOUT_MSECS	1000
+
+/* how long a xenogc may need to settle after being disabled */
+#define XENOGC_TIMEOUT_MSECS	8000
+#define XENOGC_POLL_MSECS	10
+
 /*
  *
  */
 static void mdelay(int msecs)
 {
-	const unsigned long ticks_per_msec = 162000 / 4;
 	unsigned long start_ticks, loops;
 
-	loops = msecs * ticks_per_msec;
+	loops = msecs_to_ticks(msecs);
 	start_ticks = ticks();
 	while(ticks() - start_ticks < loops)
 		;
 }
 
+/*
+ * Checks if a timeout started at start_ticks has already expired.
+ */
+static inline int timed_out(unsigned long start_ticks, unsigned long timeout)
+{
+	return ticks() - start_ticks >= timeout;
+}
+
 
 /*
  * DI
@@ -135,14 +168,29 @@ static void mdelay(int msecs)
 static void di_reset(void)
 {
         unsigned long *reset_reg = FLIPPER_RESET;
-        unsigned long reset, i;
+        unsigned long reset;
 
         reset = readl(reset_reg);
         writel((reset & ~FLIPPER_RESET_DVD) | 1, reset_reg);
-        for (i = 0; i < 0xfffff; i++) ;
+        mdelay(DI_RESET_HOLD_MSECS);
         writel((reset | FLIPPER_RESET_DVD) | 1, reset_reg);
 }
 
+/*
+ * Waits for the drive to finish the current transfer, if any.
+ */
+static int di_wait_idle(unsigned long timeout)
+{
+        unsigned long *cr_reg = io_base + DI_CR;
+        unsigned long start_ticks = ticks();
+
+        while ((readl(cr_reg) & DI_CR_TSTART)) {
+                if (timed_out(start_ticks, timeout))
+                        return -1;
+        }
+        return 0;
+}
+
 /*
  * Calms down and brings the DVD unit to a known state.
  */
@@ -177,6 +225,10 @@ static int di_run_command(unsigned long *cmdbuf, void *data, int len, int mode)
         unsigned long *cr_reg = io_base + DI_CR;
         int result = 0;
 
+        /* never clobber a command still in progress */
+        if (di_wait_idle(msecs_to_ticks(DI_COMMAND_TIMEOUT_MSECS)))
+                return -1;
+
         writel(cmdbuf[0], io_base + DI_CMDBUF0);
         writel(cmdbuf[1], io_base + DI_CMDBUF1);
         writel(cmdbuf[2], io_base + DI_CMDBUF2);
@@ -199,9 +251,9 @@ static int di_run_command(unsigned long *cmdbuf, void *data, int len, int mode)
 
                 if (!(mode & __DI_DONT_WAIT)) {
                         /* busy-wait */
-                        while ((readl(cr_reg) & DI_CR_TSTART)) ;
-
-                        if ((readl(sr_reg) & DI_SR_DEINT))
+                        if (di_wait_idle(msecs_to_ticks(DI_COMMAND_TIMEOUT_MSECS)))
+                                result = -1;
+                        else if ((readl(sr_reg) & DI_SR_DEINT))
                                 result = -1;
                 }
 
@@ -291,23 +343,46 @@ static void di_disable_xenogc(void)
  */
 static int di_test_debug_features(void)
 {
+        unsigned long start_ticks;
         int result;
 
         result = di_enable_debug_commands();
         if (result) {
                 di_reset();
-                result = di_enable_debug_commands();
+
+                /* retry until the drive comes back from reset */
+                start_ticks = ticks();
+                do {
+                        result = di_enable_debug_commands();
+                } while (result &&
+                         !timed_out(start_ticks,
+                                    msecs_to_ticks(DI_RESET_TIMEOUT_MSECS)));
         }
 
         return result;
 }
 
+/*
+ * Checks if the drive reset logic word is back to zero.
+ */
+static int di_fw_reset_done(void)
+{
+        unsigned long val = 1;
+
+        if (di_enable_debug_commands())
+                return 0;
+        if (di_fw_read_meml(&val, 0x40d100))
+                return 0;
+        le32_to_cpus((uint32_t *)&val);
+        return (val & 0xffff) == 0x0000;
+}
+
 /*
  * Checks for a xenogc and cleanly disables it.
  */
 static void sdre_disable_xenogc(void)
 {
-	int i;
+	unsigned long start_ticks;
 	unsigned long val;
 
 	if (!di_test_debug_features()) {
@@ -317,23 +392,21 @@ static void sdre_disable_xenogc(void)
 				 * Disable the drivechip, but leave it enough
 				 * time to xfer the apploader patch.
 				 * Otherwise, it will misbehave.
+				 *
+				 * The drive does not take commands while the
+				 * chip is busy, so poll until it answers and
+				 * its reset logic is back to zero.
+				 * 8 secs was always enough, so give up then.
 				 */
 				di_disable_xenogc();
-				mdelay(8000); /* 8 secs seems enough */
 
-				/*
-				 * Wait for reset logic to become zero.
-				 * (Usually, not needed).
-				 */
-				for(i=0; i < 0x1111; i++) {
-					val = 1;
-        				di_enable_debug_commands();
-	        			di_fw_read_meml(&val, 0x40d100);
-					le32_to_cpus((uint32_t *)&val);
-					val &= 0xffff;
-					if (val == 0x0000)
+				start_ticks = ticks();
+				while (!di_fw_reset_done()) {
+					if (timed_out(start_ticks,
+						      msecs_to_ticks(XENOGC_TIMEOUT_MSECS)))
 						break;
 					rumble(1);
+					mdelay(XENOGC_POLL_MSECS);
 				}
 				rumble(0);
 			}
@@ -347,24 +420,61 @@ static void sdre_disable_xenogc(void)
  */
 static void relocate_sections(struct dolrel_control *dc)
 {
-	struct dolrel_section *section = (struct dolrel_section *)(dc + 1);
-	void *src_address = dc->src_address;
+	struct dolrel_section *section = dc->sections;
 	uint32_t nr_sections = dc->nr_sections;
 
+	/* udolrel ordered the steps so no source is overwritten too early */
 	while (nr_sections > 0) {
-		memcpy(section->dst_address, src_address, section->length);
-		flush_dcache_range(section->dst_address,
-				   section->dst_address + section->length);
-		invalidate_icache_range(section->dst_address,
-					section->dst_address + section->length);
+		dbg_printf("sdre: %p-%p %s\n", section->dst_address,
+			   section->dst_address + section->length,
+			   (section->flags & DOLREL_SECTION_ZERO) ? "clear" :
+			   (section->packed_length != section->length) ?
+			   "unpack" : "copy");
+		if (section->flags & DOLREL_SECTION_ZERO)
+			memset(section->dst_address, 0, section->length);
+		else if (section->packed_length == section->length)
+			memmove(section->dst_address, section->src_address,
+				section->length);
+		else
+			lz_decompress(section->dst_address, section->length,
+				      section->src_address,
+				      section->packed_length);
+
+		/* only code needs the instruction cache refreshed */
+		if (section->flags & DOLREL_SECTION_TEXT)
+			flush_icache_range(section->dst_address,
+					   section->dst_address +
+					   section->length);
+		else
+			flush_dcache_range(section->dst_address,
+					   section->dst_address +
+					   section->length);
 
-		src_address += section->length;
 		nr_sections--;
 
 		section++;
 	}
 }
 
+/*
+ * Keeps the trace ring out of the way of the relocated DOL.
+ */
+static void sdre_trace_reserve(struct dolrel_control *dc)
+{
+	struct dolrel_section *section = dc->sections;
+	uint32_t nr_sections = dc->nr_sections;
+
+	while (nr_sections > 0) {
+		trace_reserve((unsigned long)section->dst_address,
+			      (unsigned long)section->dst_address +
+			      section->length);
+		nr_sections--;
+		section++;
+	}
+	trace_reserve((unsigned long)dc->address_bss,
+		      (unsigned long)dc->address_bss + dc->size_bss);
+}
+
 typedef void (*entry_point_t) (void);
 
 int main(void)
@@ -375,22 +485,47 @@ int main(void)
 
 	local_irq_disable();
 
-	if (dc->flags & (DOLREL_FLAG_STOP_MOTOR|DOLREL_FLAG_DISABLE_XENOGC))
+#ifdef DEBUG
+	gcn_con_init();
+#endif
+	dbg_printf("sdre: %u steps, entry point %p\n", dc->nr_sections,
+		   dc->entry_point);
+
+	trace_attach();
+	trace_event(BOOT_TRACE_SDRE_START, 0);
+	sdre_trace_reserve(dc);
+
+	if (dc->flags & (DOLREL_FLAG_STOP_MOTOR|DOLREL_FLAG_DISABLE_XENOGC)) {
+		trace_event(BOOT_TRACE_SDRE_QUIESCE, 0);
 		di_quiesce();
+	}
 
-	if (dc->flags & DOLREL_FLAG_STOP_MOTOR)
+	if (dc->flags & DOLREL_FLAG_STOP_MOTOR) {
+		trace_event(BOOT_TRACE_SDRE_STOP_MOTOR, 0);
 		di_stop_motor();
+	}
 
-	if (dc->flags & DOLREL_FLAG_DISABLE_XENOGC)
+	if (dc->flags & DOLREL_FLAG_DISABLE_XENOGC) {
+		trace_event(BOOT_TRACE_SDRE_XENOGC, 0);
 		sdre_disable_xenogc();
+	}
 
+	trace_event(BOOT_TRACE_SDRE_RELOCATE, dc->nr_sections);
 	relocate_sections(dc);
 	if (dc->size_bss) {
+		trace_event(BOOT_TRACE_SDRE_BSS, 0);
 		memset(dc->address_bss, 0, dc->size_bss);
 		flush_dcache_range(dc->address_bss,
 				   dc->address_bss + dc->size_bss);
 	}
 
+	trace_event(BOOT_TRACE_SDRE_JUMP, 0);
+	trace_flush();
+
+#ifdef DEBUG
+	gcn_con_exit();
+#endif
+
 	f = (entry_point_t) dc->entry_point;
 	(*f) ();
 
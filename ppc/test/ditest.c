@@ -0,0 +1,421 @@
+/*
+ * ditest.c
+ *
+ * Tests the drive interface polling of the relocation engine (sdre).
+ * This program is part of the cubeboot-tools package.
+ *
+ * sdre.c is built for the host (make check-host) and its register
+ * accesses land on a fake drive, which can be told to stay busy, refuse
+ * commands or take its time to come back from a reset. The timebase is
+ * virtual too, so the multi-second timeouts run in no time.
+ *
+ * Copyright (C) 2005-2006 The GameCube Linux Team
+ * Copyright (C) 2005,2006 Albert Herranz
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/* the code under test, its static functions included */
+#define main sdre_main
+#include "../sdre/sdre.c"
+#undef main
+
+struct dolrel_control __dolrel_control;
+
+/* how far the virtual timebase moves on each read */
+#define TICKS_PER_READ		100
+
+/* what the drive answers at 0x40c60a when a xenogc is fitted */
+#define XENOGC_ID		0xf710fff7
+
+#define NEVER			(~0UL)
+
+#define msecs(ms)		msecs_to_ticks((unsigned long)(ms))
+
+/* the fake drive */
+struct drive {
+	/* DI_CR reads before a command completes, -1 for never */
+	int busy_polls;
+	/* a xenogc is fitted */
+	int xenogc;
+	/* the debug command set is refused until the next reset */
+	int debug_locked;
+	/* how long the drive takes to come back from a reset */
+	unsigned long reset_ticks;
+	/* how long a disabled xenogc keeps the drive busy, and until the
+	 * reset logic word reads zero */
+	unsigned long xenogc_busy_ticks;
+	unsigned long xenogc_settle_ticks;
+
+	/* commands are refused before this time */
+	unsigned long ready_at;
+	/* the reset logic word reads non-zero before this time */
+	unsigned long reset_clear_at;
+
+	int polls_left;
+	unsigned long reset_reg;
+	unsigned long sr, cvr, cr, data;
+	unsigned long cmdbuf[3], mar, length;
+
+	int commands;
+	int clobbers;
+	int resets;
+	int disables;
+	int rumbling;
+};
+
+static struct drive drive;
+static unsigned long tb;
+static int failures;
+
+#define expect(cond, what) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "FAIL %s: %s\n", what, #cond); \
+			failures++; \
+		} \
+	} while (0)
+
+unsigned long ticks(void)
+{
+	tb += TICKS_PER_READ;
+	return tb;
+}
+
+void flush_dcache_range(void *start, void *stop)
+{
+}
+
+void invalidate_dcache_range(void *start, void *stop)
+{
+}
+
+void invalidate_icache_range(void *start, void *stop)
+{
+}
+
+void flush_icache_range(void *start, void *stop)
+{
+}
+
+void rumble(int enable)
+{
+	drive.rumbling = enable;
+}
+
+void panic(char *text)
+{
+	fprintf(stderr, "panic: %s\n", text);
+	exit(1);
+}
+
+/*
+ * Puts the fake drive back into its power on state.
+ */
+static void reset_drive(void)
+{
+	memset(&drive, 0, sizeof(drive));
+	drive.reset_reg = FLIPPER_RESET_DVD | 1;
+}
+
+/*
+ * Runs the command just started, as far as the tests care.
+ */
+static void drive_execute(void)
+{
+	unsigned long cmd = drive.cmdbuf[0];
+	int error = 0;
+
+	drive.commands++;
+
+	if (tb < drive.ready_at) {
+		error = 1;
+	} else if (cmd == CMDBUF(0xff, 0x01, 'M', 'A') ||
+		   cmd == CMDBUF(0xff, 0x00, 'D', 'V')) {
+		error = drive.debug_locked;
+	} else if (cmd == 0xfe010000) {
+		if (drive.debug_locked)
+			error = 1;
+		else if (drive.cmdbuf[1] == 0x40c60a)
+			drive.data = drive.xenogc ? XENOGC_ID : 0;
+		else if (drive.cmdbuf[1] == 0x40d100)
+			drive.data = (tb < drive.reset_clear_at) ? 0x0101 : 0;
+		else
+			drive.data = 0;
+	} else if (cmd == 0x25000000) {
+		drive.disables++;
+		if (drive.xenogc) {
+			drive.ready_at = tb + drive.xenogc_busy_ticks;
+			drive.reset_clear_at = tb + drive.xenogc_settle_ticks;
+		}
+	} else if (cmd != 0xe3000000) {
+		error = 1;
+	}
+
+	drive.sr |= error ? DI_SR_DEINT : DI_SR_TCINT;
+	drive.polls_left = drive.busy_polls;
+}
+
+/*
+ *
+ */
+static unsigned long *drive_reg(volatile void *addr)
+{
+	unsigned long reg = (unsigned long)addr - (unsigned long)io_base;
+
+	if ((void *)addr == FLIPPER_RESET)
+		return &drive.reset_reg;
+
+	switch (reg) {
+	case DI_SR:
+		return &drive.sr;
+	case DI_CVR:
+		return &drive.cvr;
+	case DI_CMDBUF0:
+	case DI_CMDBUF1:
+	case DI_CMDBUF2:
+		return &drive.cmdbuf[(reg - DI_CMDBUF0) / 4];
+	case DI_MAR:
+		return &drive.mar;
+	case DI_LENGTH:
+		return &drive.length;
+	case DI_CR:
+		return &drive.cr;
+	case DI_DATA:
+		return &drive.data;
+	}
+	fprintf(stderr, "unexpected register access at %p\n", addr);
+	exit(1);
+}
+
+unsigned long readl(volatile void *addr)
+{
+	unsigned long *reg = drive_reg(addr);
+
+	if (reg == &drive.cr && (drive.cr & DI_CR_TSTART)) {
+		if (drive.polls_left == 0)
+			drive.cr &= ~DI_CR_TSTART;
+		else if (drive.polls_left > 0)
+			drive.polls_left--;
+	}
+	return *reg;
+}
+
+void writel(unsigned long b, volatile void *addr)
+{
+	unsigned long *reg = drive_reg(addr);
+	unsigned long acks = DI_SR_BRKINT | DI_SR_TCINT | DI_SR_DEINT;
+
+	if (drive.cr & DI_CR_TSTART)
+		drive.clobbers++;
+
+	if (reg == &drive.sr) {
+		/* the interrupt bits are cleared by writing them back */
+		drive.sr = (drive.sr & ~b & acks) | (b & ~acks);
+	} else if (reg == &drive.reset_reg) {
+		if (!(b & FLIPPER_RESET_DVD)) {
+			drive.resets++;
+		} else if (!(drive.reset_reg & FLIPPER_RESET_DVD)) {
+			drive.debug_locked = 0;
+			drive.ready_at = tb + drive.reset_ticks;
+		}
+		drive.reset_reg = b;
+	} else {
+		*reg = b;
+		if (reg == &drive.cr && (b & DI_CR_TSTART))
+			drive_execute();
+	}
+}
+
+/*
+ *
+ */
+static void test_wait_idle(void)
+{
+	unsigned long start;
+
+	reset_drive();
+	start = tb;
+	expect(di_wait_idle(msecs(DI_COMMAND_TIMEOUT_MSECS)) == 0,
+	       "idle drive");
+	expect(tb - start < msecs(1), "idle drive returns at once");
+
+	reset_drive();
+	drive.cr = DI_CR_TSTART;
+	drive.polls_left = 10;
+	expect(di_wait_idle(msecs(DI_COMMAND_TIMEOUT_MSECS)) == 0,
+	       "transfer in progress");
+	expect(!(drive.cr & DI_CR_TSTART), "transfer in progress");
+
+	reset_drive();
+	drive.cr = DI_CR_TSTART;
+	drive.polls_left = -1;
+	start = tb;
+	expect(di_wait_idle(msecs(DI_COMMAND_TIMEOUT_MSECS)) == -1,
+	       "hung drive");
+	expect(tb - start >= msecs(DI_COMMAND_TIMEOUT_MSECS) &&
+	       tb - start < msecs(DI_COMMAND_TIMEOUT_MSECS + 1),
+	       "hung drive times out in time");
+}
+
+/*
+ *
+ */
+static void test_run_command(void)
+{
+	unsigned long start;
+
+	reset_drive();
+	drive.busy_polls = 5;
+	expect(di_stop_motor() == 0, "stop motor");
+	expect(drive.commands == 1, "stop motor");
+	expect(!(drive.sr & (DI_SR_TCINT | DI_SR_DEINT)),
+	       "interrupts acked");
+
+	/* a command still in progress is never clobbered */
+	reset_drive();
+	drive.cr = DI_CR_TSTART;
+	drive.polls_left = -1;
+	start = tb;
+	expect(di_stop_motor() == -1, "previous command hung");
+	expect(drive.commands == 0 && drive.clobbers == 0,
+	       "previous command hung");
+	expect(tb - start < msecs(DI_COMMAND_TIMEOUT_MSECS + 1),
+	       "previous command hung");
+
+	/* a command which never completes */
+	reset_drive();
+	drive.busy_polls = -1;
+	start = tb;
+	expect(di_stop_motor() == -1, "command hung");
+	expect(tb - start >= msecs(DI_COMMAND_TIMEOUT_MSECS) &&
+	       tb - start < msecs(DI_COMMAND_TIMEOUT_MSECS + 1),
+	       "command hung times out in time");
+
+	/* a command the drive refuses */
+	reset_drive();
+	drive.ready_at = NEVER;
+	expect(di_stop_motor() == -1, "command refused");
+	expect(!(drive.sr & DI_SR_DEINT), "error acked");
+}
+
+/*
+ *
+ */
+static void test_fw_reset_done(void)
+{
+	reset_drive();
+	expect(di_fw_reset_done(), "reset logic idle");
+
+	reset_drive();
+	drive.reset_clear_at = tb + msecs(100);
+	expect(!di_fw_reset_done(), "reset logic busy");
+	tb += msecs(100);
+	expect(di_fw_reset_done(), "reset logic back to idle");
+
+	reset_drive();
+	drive.ready_at = NEVER;
+	expect(!di_fw_reset_done(), "drive refusing commands");
+
+	reset_drive();
+	drive.debug_locked = 1;
+	expect(!di_fw_reset_done(), "debug commands refused");
+}
+
+/*
+ *
+ */
+static void test_debug_features(void)
+{
+	unsigned long start;
+
+	reset_drive();
+	expect(di_test_debug_features() == 0, "debug commands work");
+	expect(drive.resets == 0, "debug commands work, no reset");
+
+	/* locked until reset, back after half a second */
+	reset_drive();
+	drive.debug_locked = 1;
+	drive.reset_ticks = msecs(500);
+	start = tb;
+	expect(di_test_debug_features() == 0, "debug commands after reset");
+	expect(drive.resets == 1, "debug commands after reset");
+	expect(tb - start >= msecs(500) &&
+	       tb - start < msecs(DI_RESET_TIMEOUT_MSECS),
+	       "debug commands after reset, retried until back");
+
+	/* never comes back from the reset */
+	reset_drive();
+	drive.debug_locked = 1;
+	drive.reset_ticks = NEVER / 2;
+	start = tb;
+	expect(di_test_debug_features() != 0, "drive lost in reset");
+	expect(drive.resets == 1, "drive lost in reset");
+	expect(tb - start >= msecs(DI_RESET_TIMEOUT_MSECS) &&
+	       tb - start < msecs(DI_RESET_HOLD_MSECS +
+				  DI_RESET_TIMEOUT_MSECS + 1),
+	       "drive lost in reset times out in time");
+}
+
+/*
+ *
+ */
+static void test_xenogc(void)
+{
+	unsigned long start;
+
+	reset_drive();
+	sdre_disable_xenogc();
+	expect(drive.disables == 0, "no xenogc, nothing disabled");
+
+	/* busy for a second, settled after three */
+	reset_drive();
+	drive.xenogc = 1;
+	drive.xenogc_busy_ticks = msecs(1000);
+	drive.xenogc_settle_ticks = msecs(3000);
+	start = tb;
+	sdre_disable_xenogc();
+	expect(drive.disables == 1, "xenogc disabled");
+	expect(tb - start >= msecs(3000) &&
+	       tb - start < msecs(3000 + XENOGC_POLL_MSECS + 1),
+	       "xenogc polled until settled");
+	expect(!drive.rumbling, "rumble stopped");
+
+	/* never settles */
+	reset_drive();
+	drive.xenogc = 1;
+	drive.xenogc_busy_ticks = msecs(1000);
+	drive.xenogc_settle_ticks = NEVER / 2;
+	start = tb;
+	sdre_disable_xenogc();
+	expect(drive.disables == 1, "xenogc never settling");
+	expect(tb - start >= msecs(XENOGC_TIMEOUT_MSECS) &&
+	       tb - start < msecs(XENOGC_TIMEOUT_MSECS +
+				  XENOGC_POLL_MSECS + 1),
+	       "xenogc never settling times out in time");
+	expect(!drive.rumbling, "rumble stopped");
+}
+
+int main(void)
+{
+	test_wait_idle();
+	test_run_command();
+	test_fw_reset_done();
+	test_debug_features();
+	test_xenogc();
+
+	if (failures) {
+		fprintf(stderr, "%d failures\n", failures);
+		return 1;
+	}
+	printf("di: all tests passed\n");
+	return 0;
+}
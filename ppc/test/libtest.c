@@ -0,0 +1,339 @@
+/*
+ * libtest.c
+ *
+ * Tests and benchmarks the string routines of ppc/common/lib.c.
+ * This program is part of the cubeboot-tools package.
+ *
+ * It is meant to run under qemu-ppc user mode (make check, make bench),
+ * and also builds for the host with an emulated dcbz (make check-host).
+ * Buffers are mapped in the cached RAM range, as on the GameCube, so the
+ * dcbz paths get exercised.
+ *
+ * Copyright (C) 2005-2006 The GameCube Linux Team
+ * Copyright (C) 2005,2006 Albert Herranz
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+/* lib.c is built with its routines renamed, see the Makefile */
+extern void *gcn_memcpy(void *dest, const void *src, int count);
+extern void *gcn_memmove(void *dest, const void *src, int count);
+extern void *gcn_memset(void *s, int c, int count);
+extern int gcn_memcmp(const void *cs, const void *ct, int count);
+
+#ifdef HOST_SIM
+/*
+ * lib.c pokes the hardware (rumble), which the host doesn't have.
+ * The tests never get there, so the registers can read as zero.
+ */
+unsigned long readl(volatile void *addr)
+{
+	return 0;
+}
+
+void writel(unsigned long b, volatile void *addr)
+{
+}
+#endif
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE	0
+#endif
+
+#define ARENA_ADDRESS		0x80000000UL
+#define ARENA_SIZE		(16 * 1024 * 1024)
+
+/* bytes checked around each destination for stray writes */
+#define GUARD			64
+
+#define BENCH_SIZE		(4 * 1024 * 1024)
+#define BENCH_BYTES		(64 * 1024 * 1024)
+
+static unsigned char *arena;
+static unsigned char *expected;
+static int failures;
+
+/* sizes around the word and cache line thresholds, and some big ones */
+static const int sizes[] = {
+	0, 1, 2, 3, 4, 5, 7, 8, 15, 16, 31, 32, 33, 63, 64, 65, 95, 96,
+	97, 127, 128, 129, 255, 256, 257, 1000, 4096, 65536 + 13,
+};
+#define NR_SIZES	(sizeof(sizes) / sizeof(sizes[0]))
+
+/* memmove distances, below and above L1_CACHE_LINE_SIZE */
+static const int distances[] = {
+	1, 2, 3, 4, 5, 8, 16, 28, 31, 32, 33, 36, 63, 64, 65, 100, 4099,
+};
+#define NR_DISTANCES	(sizeof(distances) / sizeof(distances[0]))
+
+/*
+ *
+ */
+static void map_arena(void)
+{
+	arena = mmap((void *)ARENA_ADDRESS, ARENA_SIZE,
+		     PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+	if (arena == MAP_FAILED || arena != (void *)ARENA_ADDRESS) {
+		fprintf(stderr, "can't map the test arena at 0x%08lx: %s\n",
+			ARENA_ADDRESS, strerror(errno));
+		exit(1);
+	}
+	expected = malloc(ARENA_SIZE);
+	if (!expected) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+}
+
+/*
+ * Fills the arena, and the expected copy of it, with a known pattern.
+ */
+static void fill_arena(size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		arena[i] = (i * 7 + (i >> 8) + 1) | 1;
+	memcpy(expected, arena, len);
+}
+
+/*
+ *
+ */
+static void check(const char *what, int size, int dst, int src, size_t len)
+{
+	size_t i;
+
+	if (!memcmp(arena, expected, len))
+		return;
+
+	for (i = 0; arena[i] == expected[i]; i++)
+		;
+	fprintf(stderr, "FAIL %s size %d dst +%d src +%d: "
+		"byte +%lu is 0x%02x, expected 0x%02x\n", what, size, dst,
+		src, (unsigned long)i, arena[i], expected[i]);
+	failures++;
+}
+
+/*
+ *
+ */
+static void test_memcpy(void)
+{
+	int i, d, s, size, src;
+	size_t len;
+
+	for (i = 0; i < NR_SIZES; i++) {
+		size = sizes[i];
+		src = 2 * GUARD + size + 64;
+		len = src + size + 64 + GUARD;
+		for (d = 0; d < 8; d++) {
+			for (s = 0; s < 8; s++) {
+				fill_arena(len);
+				gcn_memcpy(arena + GUARD + d, arena + src + s,
+					   size);
+				memcpy(expected + GUARD + d,
+				       expected + src + s, size);
+				check("memcpy", size, d, s, len);
+			}
+		}
+	}
+}
+
+/*
+ *
+ */
+static void test_memset(void)
+{
+	static const int values[] = { 0, 0xa5, 0x100 };
+	int i, d, v, size;
+	size_t len;
+
+	for (i = 0; i < NR_SIZES; i++) {
+		size = sizes[i];
+		len = GUARD + size + 64 + GUARD;
+		for (d = 0; d < 32; d++) {
+			for (v = 0; v < 3; v++) {
+				fill_arena(len);
+				gcn_memset(arena + GUARD + d, values[v], size);
+				memset(expected + GUARD + d, values[v], size);
+				check("memset", size, d, v, len);
+			}
+		}
+	}
+}
+
+/*
+ * Overlapping moves both ways, from every alignment, including the
+ * forward ones handed to memcpy and its dcbz path.
+ */
+static void test_memmove(void)
+{
+	int i, j, d, dist, size, dst, src;
+	size_t len;
+
+	for (i = 0; i < NR_SIZES; i++) {
+		size = sizes[i];
+		for (j = 0; j < NR_DISTANCES; j++) {
+			dist = distances[j];
+			len = GUARD + dist + size + 64 + GUARD;
+			for (d = 0; d < 32; d++) {
+				/* forwards, dst below src */
+				dst = GUARD + d;
+				src = dst + dist;
+				fill_arena(len);
+				gcn_memmove(arena + dst, arena + src, size);
+				memmove(expected + dst, expected + src, size);
+				check("memmove down", size, dst, src, len);
+
+				/* backwards, dst above src */
+				src = GUARD + d;
+				dst = src + dist;
+				fill_arena(len);
+				gcn_memmove(arena + dst, arena + src, size);
+				memmove(expected + dst, expected + src, size);
+				check("memmove up", size, dst, src, len);
+			}
+		}
+	}
+}
+
+/*
+ *
+ */
+static void test_memcmp(void)
+{
+	static const char a[] = "cubeboot", b[] = "cubebooT";
+
+	if (gcn_memcmp(a, a, sizeof(a)) != 0 ||
+	    gcn_memcmp(a, b, sizeof(a)) <= 0 ||
+	    gcn_memcmp(b, a, sizeof(a)) >= 0 ||
+	    gcn_memcmp(a, b, 7) != 0) {
+		fprintf(stderr, "FAIL memcmp\n");
+		failures++;
+	}
+}
+
+/*
+ *
+ */
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Byte at a time references, what lib.c used to do.
+ */
+static void *byte_memcpy(void *dest, const void *src, int count)
+{
+	volatile char *d = dest;
+	const char *s = src;
+
+	while (count-- > 0)
+		*d++ = *s++;
+	return dest;
+}
+
+static void *byte_memset(void *s, int c, int count)
+{
+	volatile char *xs = s;
+
+	while (count-- > 0)
+		*xs++ = c;
+	return s;
+}
+
+/*
+ *
+ */
+static void bench_one(const char *what, int op,
+		      void *(*copy)(void *, const void *, int),
+		      void *(*set)(void *, int, int))
+{
+	unsigned char *dst = arena, *src = arena + BENCH_SIZE + 32;
+	double start, elapsed;
+	long done;
+
+	start = now();
+	for (done = 0; done < BENCH_BYTES; done += BENCH_SIZE) {
+		switch (op) {
+		case 0:
+			copy(dst, src, BENCH_SIZE);
+			break;
+		case 1:
+			copy(dst, dst + 40, BENCH_SIZE);
+			break;
+		case 2:
+			set(dst, 0, BENCH_SIZE);
+			break;
+		}
+	}
+	elapsed = now() - start;
+	printf("%-24s %8.1f MB/s\n", what,
+	       BENCH_BYTES / elapsed / (1024 * 1024));
+}
+
+/*
+ *
+ */
+static void bench(void)
+{
+	bench_one("memcpy", 0, gcn_memcpy, NULL);
+	bench_one("memcpy (bytes)", 0, byte_memcpy, NULL);
+	bench_one("memmove (overlapping)", 1, gcn_memmove, NULL);
+	bench_one("memset 0", 2, NULL, gcn_memset);
+	bench_one("memset 0 (bytes)", 2, NULL, byte_memset);
+}
+
+int main(int argc, char *argv[])
+{
+	int ch;
+	int do_bench = 0;
+
+	while ((ch = getopt(argc, argv, "b")) != -1) {
+		switch (ch) {
+		case 'b':
+			do_bench = 1;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-b]\n", argv[0]);
+			exit(1);
+		}
+	}
+
+	map_arena();
+
+	if (do_bench) {
+		bench();
+		return 0;
+	}
+
+	test_memcpy();
+	test_memset();
+	test_memmove();
+	test_memcmp();
+
+	if (failures) {
+		fprintf(stderr, "%d failures\n", failures);
+		return 1;
+	}
+	printf("lib: all tests passed\n");
+	return 0;
+}
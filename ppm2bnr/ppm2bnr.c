@@ -20,12 +20,15 @@
 #include <netpbm/pam.h>
 
 #include "../include/lib.h"
+#include "../include/cache.h"
 #include "../include/bnr.h"
+#include "../include/cubeboot.h"
 
 #define _GNU_SOURCE
 #include <getopt.h>
 
-#define PPM2BNR_VERSION "V0.1-20122005"
+/* banners are cached under it too */
+#define PPM2BNR_VERSION "V0.2-20261017"
 
 #define DEFAULT_GAME_NAME	"Bootable iso9660 Disc"
 #define DEFAULT_COMPANY		"(company name)"
@@ -37,25 +40,19 @@
 const char *__progname;
 
 
-struct banner_header bh;
-struct banner_description bd;
-
-unsigned short banner_raster[BNR_WIDTH*BNR_HEIGHT];
-
-
 /**
  *
  */
-int convert_ppm_to_bnr(FILE *fout, FILE *fin, struct banner_description *bd)
+int convert_ppm_to_bnr(struct writer *w, FILE *fin,
+		       struct banner_description *bd)
 {
-	int tiles, cols, rows;
-	int tile, col, row;
+	unsigned char rgb[CB_BNR_RGB_SIZE], *outp;
+	char bnr[CB_BNR_SIZE];
+	int cols, rows;
 	int x, y;
-	unsigned long r ,g ,b;
 	pixel **pixbuf, p;
 	pixval maxval;
-
-	unsigned short *outp;
+	int error;
 
 	pixbuf = ppm_readppm(fin, &cols, &rows, &maxval);
 	if (cols != BNR_WIDTH || rows != BNR_HEIGHT) {
@@ -63,45 +60,25 @@ int convert_ppm_to_bnr(FILE *fout, FILE *fin, struct banner_description *bd)
 			BNR_WIDTH, BNR_HEIGHT);
 	}
 
-	memset(&bh, 0, sizeof(bh));
-	memcpy(bh.magic, BNR_MAGIC1, 4);
-
-	if (fwrite(&bh, sizeof(bh), 1, fout) != 1)
-		die("write failed: %s\n", strerror(errno));
-
-	tiles = (cols * rows) / BNR_TILE_SIZE;
-	col = row = 0;
-
-	outp = banner_raster;
-	for(tile = 0; tile < tiles; tile++) {	
-		for(y = 0; y < 4; y++) {
-			for(x = 0; x < 4; x++) {
-				p = pixbuf[row+y][col+x];
-				r = PPM_GETR(p);
-				g = PPM_GETG(p);
-				b = PPM_GETB(p);
-
-				/* convert from 8 to 5 bits */
-				r = (r * (1<<5)) / 256;
-				g = (g * (1<<5)) / 256;
-				b = (b * (1<<5)) / 256;
-
-				*outp++ = cpu_to_be16((1<<15) | (r << 10) | (g << 5) | b);
-			}
-		}
-
-		col += 4;
-		if (col >= cols) {
-			col = 0;
-			row += 4;
+	outp = rgb;
+	for(y = 0; y < rows; y++) {
+		for(x = 0; x < cols; x++) {
+			p = pixbuf[y][x];
+			*outp++ = PPM_GETR(p);
+			*outp++ = PPM_GETG(p);
+			*outp++ = PPM_GETB(p);
 		}
 	}
 
 	ppm_freearray(pixbuf, rows);
 
-	fwrite(banner_raster, sizeof(banner_raster), 1, fout);
+	error = cb_bnr_encode(rgb, bd, bnr, sizeof(bnr));
+	if (error)
+		die("can't encode banner: %s\n", cb_strerror(error));
 
-	fwrite(bd, sizeof(*bd), 1, fout);
+	if (writer_write(w, bnr, sizeof(bnr)) < 0)
+		die("write failed: %s\n", strerror(errno));
+	return 0;
 }
 
 /**
@@ -212,6 +189,10 @@ int main(int argc, char *argv[])
 {
 	char *outfile = NULL, *infile = NULL;
 	FILE *fout, *fin;
+	struct cache_key key;
+	struct banner_description bd;
+	struct writer w;
+	int use_cache = 0;
         char *p;
 	int ch;
 	int result;
@@ -295,6 +276,17 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	if (!bd.name[0])
+		strcpy(bd.name, DEFAULT_GAME_NAME);
+	if (!bd.company[0])
+		strcpy(bd.company, DEFAULT_COMPANY);
+	if (!bd.full_name[0])
+		strcpy(bd.full_name, DEFAULT_FULL_GAME_TITLE);
+	if (!bd.full_company[0])
+		strcpy(bd.full_company, DEFAULT_COMPANY);
+	if (!bd.description[0])
+		strcpy(bd.description, DEFAULT_GAME_DESCR);
+
 	if (!outfile) {
 		outfile = "*stdout*";
 		fout = stdout;
@@ -303,6 +295,18 @@ int main(int argc, char *argv[])
 			outfile = "*stdout*";
 			fout = stdout;
 		} else {
+			/* input from a pipe can't be hashed in advance */
+			use_cache = (fin != stdin);
+			if (use_cache) {
+				cache_key_init(&key, "ppm2bnr", PPM2BNR_VERSION);
+				cache_key_add_string(&key, cb_build_id());
+				cache_key_add(&key, &bd, sizeof(bd));
+				cache_key_add_file(&key, infile);
+				if (cache_fetch(&key, outfile)) {
+					cache_report(stderr);
+					return 0;
+				}
+			}
 			fout = fopen(outfile, "w");
 			if (!fout) {
 				die("%s: can't open output file: %s\n",
@@ -311,20 +315,20 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	if (!bd.name[0])
-		strcpy(bd.name, DEFAULT_GAME_NAME);
-	if (!bd.company[0])
-		strcpy(bd.company, DEFAULT_COMPANY);
-	if (!bd.full_name[0])
-		strcpy(bd.full_name, DEFAULT_FULL_GAME_TITLE);
-	if (!bd.full_company[0])
-		strcpy(bd.full_company, DEFAULT_COMPANY);
-	if (!bd.description[0])
-		strcpy(bd.description, DEFAULT_GAME_DESCR);
-
-	convert_ppm_to_bnr(fout, fin, &bd);
+	writer_init(&w, fileno(fout), WRITER_BUFFER_SIZE);
+	convert_ppm_to_bnr(&w, fin, &bd);
+	if (writer_release(&w) < 0)
+		die("%s: can't write output file: %s\n", outfile,
+		    strerror(errno));
 
-	fclose(fout);
+	if (fclose(fout))
+		die("%s: can't close output file: %s\n", outfile,
+		    strerror(errno));
 	fclose(fin);
+
+	if (use_cache) {
+		cache_store(&key, outfile);
+		cache_report(stderr);
+	}
 }
 
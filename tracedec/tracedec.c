@@ -0,0 +1,281 @@
+/**
+ * tracedec.c
+ *
+ * Decodes the boot trace ring from a GameCube memory dump.
+ * This program is part of the cubeboot-tools package.
+ *
+ * Copyright (C) 2005-2006 The GameCube Linux Team
+ * Copyright (C) 2005,2006 Albert Herranz
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+
+#include "../include/lib.h"
+#include "../include/boottrace.h"
+
+#define _GNU_SOURCE
+#include <getopt.h>
+
+#define TRACEDEC_VERSION "V0.1-20261017"
+
+#define MEM1_ADDRESS	0x80000000UL
+
+const char *__progname;
+
+struct phase_stats {
+	unsigned int event;	/* id and argument */
+	unsigned long count;
+	unsigned long long total;
+	unsigned long max;
+};
+
+static struct phase_stats phases[BOOT_TRACE_RECORDS];
+static int nr_phases;
+
+/* dumps from the host apploader simulator are in host byte order */
+static int host_order;
+
+static uint32_t trace_to_cpu(uint32_t val)
+{
+	return host_order ? val : be32_to_cpu(val);
+}
+
+/*
+ *
+ */
+static const char *event_name(unsigned int id)
+{
+	switch (id) {
+	case BOOT_TRACE_AL_START:		return "al_start";
+	case BOOT_TRACE_AL_PATCH_IPL:		return "al_patch_ipl";
+	case BOOT_TRACE_AL_PATCH_IPL_DONE:	return "al_patch_ipl_done";
+	case BOOT_TRACE_AL_ENTER:		return "al_enter";
+	case BOOT_TRACE_AL_LOAD:		return "al_load";
+	case BOOT_TRACE_AL_EXIT:		return "al_exit";
+	case BOOT_TRACE_SDRE_START:		return "sdre_start";
+	case BOOT_TRACE_SDRE_QUIESCE:		return "sdre_quiesce";
+	case BOOT_TRACE_SDRE_STOP_MOTOR:	return "sdre_stop_motor";
+	case BOOT_TRACE_SDRE_XENOGC:		return "sdre_xenogc";
+	case BOOT_TRACE_SDRE_RELOCATE:		return "sdre_relocate";
+	case BOOT_TRACE_SDRE_BSS:		return "sdre_bss";
+	case BOOT_TRACE_SDRE_JUMP:		return "sdre_jump";
+	default:				return "unknown";
+	}
+}
+
+/*
+ * Only apploader steps are told apart by their argument.
+ */
+static unsigned int phase_key(unsigned int event)
+{
+	if (boot_trace_event_id(event) == BOOT_TRACE_AL_LOAD)
+		return event;
+	return BOOT_TRACE_EVENT(boot_trace_event_id(event), 0);
+}
+
+static void account_phase(unsigned int event, unsigned long ticks)
+{
+	struct phase_stats *ps;
+	unsigned int key = phase_key(event);
+	int i;
+
+	for (i = 0; i < nr_phases; i++) {
+		if (phases[i].event == key)
+			break;
+	}
+	ps = &phases[i];
+	if (i == nr_phases) {
+		memset(ps, 0, sizeof(*ps));
+		ps->event = key;
+		nr_phases++;
+	}
+
+	ps->count++;
+	ps->total += ticks;
+	if (ticks > ps->max)
+		ps->max = ticks;
+}
+
+static void format_event(char *buf, size_t size, unsigned int event)
+{
+	if (boot_trace_event_id(event) == BOOT_TRACE_AL_LOAD)
+		snprintf(buf, size, "%s step %u",
+			 event_name(boot_trace_event_id(event)),
+			 boot_trace_event_arg(event));
+	else
+		snprintf(buf, size, "%s",
+			 event_name(boot_trace_event_id(event)));
+}
+
+/*
+ * Prints the trace events, oldest first, and the time spent in each
+ * phase, a phase lasting from its event to the next one.
+ */
+static void decode_trace(struct boot_trace *bt)
+{
+	struct boot_trace_record *record;
+	uint32_t head, nr_records, nr, first, i;
+	unsigned long ticks_per_sec, ticks, start, prev, delta;
+	unsigned int event;
+	char name[64];
+	int k;
+
+	head = trace_to_cpu(bt->head);
+	nr_records = trace_to_cpu(bt->nr_records);
+	ticks_per_sec = trace_to_cpu(bt->ticks_per_sec);
+
+	if (nr_records != BOOT_TRACE_RECORDS)
+		die("unexpected ring size %u\n", nr_records);
+	if (!ticks_per_sec)
+		ticks_per_sec = BOOT_TRACE_TICKS_PER_SEC;
+
+	nr = (head > nr_records) ? nr_records : head;
+	first = head - nr;
+	if (head > nr_records)
+		printf("(ring wrapped, %u oldest events lost)\n\n", first);
+
+	printf("%4s %12s %12s  %s\n", "#", "time (us)", "delta (us)",
+	       "event");
+
+	start = prev = 0;
+	for (i = 0; i < nr; i++) {
+		record = &bt->records[(first + i) & (nr_records - 1)];
+		ticks = trace_to_cpu(record->ticks);
+		event = trace_to_cpu(record->event);
+
+		if (i == 0)
+			start = prev = ticks;
+		delta = (uint32_t)(ticks - prev);
+
+		/* the previous phase ends here */
+		if (i > 0)
+			account_phase(trace_to_cpu(bt->records[(first + i - 1) &
+						   (nr_records - 1)].event),
+				      delta);
+
+		format_event(name, sizeof(name), event);
+		printf("%4u %12.1f %12.1f  %s\n", first + i,
+		       (uint32_t)(ticks - start) * 1e6 / ticks_per_sec,
+		       delta * 1e6 / ticks_per_sec, name);
+		prev = ticks;
+	}
+
+	printf("\n%-24s %6s %12s %12s\n", "phase", "count", "total (us)",
+	       "max (us)");
+	for (k = 0; k < nr_phases; k++) {
+		format_event(name, sizeof(name), phases[k].event);
+		printf("%-24s %6lu %12.1f %12.1f\n", name, phases[k].count,
+		       phases[k].total * 1e6 / ticks_per_sec,
+		       phases[k].max * 1e6 / ticks_per_sec);
+	}
+	if (nr > 1)
+		printf("\ntotal %.1f us\n",
+		       (uint32_t)(prev - start) * 1e6 / ticks_per_sec);
+}
+
+/*
+ *
+ */
+void version(void)
+{
+	printf("version %s\n", TRACEDEC_VERSION);
+	exit(2);
+}
+
+/*
+ *
+ */
+void usage(void)
+{
+	fprintf(stderr,
+		"Usage: %s [OPTION] DUMPFILE" "\n"
+		"  -b, --base=ADDRESS      address of the first dumped byte" "\n"
+		"      (default 0x80000000, or the ring address if the dump"
+		" is just the ring)" "\n"
+		"  -v, --version           show version" "\n",
+		__progname);
+	exit(1);
+}
+
+/*
+ *
+ */
+int main(int argc, char *argv[])
+{
+	unsigned long base = 0;
+	char *infile;
+	struct mapped_file mf;
+	void *dump;
+	off_t dump_size;
+	struct boot_trace *bt;
+	char *p;
+	int ch;
+
+	struct option long_options[] = {
+		{"base", 1, NULL, 'b'},
+		{"version", 0, NULL, 'v'},
+		{"help", 0, NULL, 'h'},
+		{0, 0, 0, 0}
+	};
+#define SHORT_OPTIONS "b:vh"
+
+	p = strrchr(argv[0], '/');
+	__progname = (p && p[1]) ? p + 1 : argv[0];
+
+	while ((ch = getopt_long(argc, argv, SHORT_OPTIONS,
+				 long_options, NULL)) != -1) {
+		switch (ch) {
+		case 'b':
+			base = strtoul(optarg, &p, 0);
+			if (*p)
+				usage();
+			break;
+		case 'v':
+			version();
+			break;
+		case 'h':
+		case '?':
+		default:
+			usage();
+			break;
+		}
+	}
+
+	if (argc - optind != 1)
+		usage();
+	infile = argv[optind];
+
+	map_file(infile, &mf);
+	dump = mf.data;
+	dump_size = mf.size;
+
+	if (!base)
+		base = (dump_size == sizeof(*bt)) ?
+			BOOT_TRACE_ADDRESS : MEM1_ADDRESS;
+	if (base > BOOT_TRACE_ADDRESS ||
+	    BOOT_TRACE_ADDRESS - base + sizeof(*bt) > dump_size)
+		die("%s: dump does not cover the trace ring at 0x%08x\n",
+		    infile, BOOT_TRACE_ADDRESS);
+
+	bt = dump + (BOOT_TRACE_ADDRESS - base);
+	if (be32_to_cpu(bt->magic) != BOOT_TRACE_MAGIC) {
+		if (bt->magic != BOOT_TRACE_MAGIC)
+			die("%s: no boot trace found\n", infile);
+		host_order = 1;
+	}
+
+	decode_trace(bt);
+
+	unmap_file(&mf);
+
+	return 0;
+}
@@ -15,12 +15,10 @@
  */
 
 /*
- * CAUTION:
- * This program is currently really dumb and lacks lots of checks.
- * Use it _ONLY_ if you know what you're doing.
- *
- * Currently, the relocation engine will work _only_ if the memory areas used
- * by the original and resulting DOLs do not overlap.
+ * The relocation engine runs at a fixed address, the original sections
+ * are staged wherever they get in the way the least (see -p), and the
+ * engine is told in which order to move them so none gets overwritten.
+ * Only sections landing on the engine itself are refused.
  *
  */
 
@@ -28,254 +26,115 @@
 #include <stdio.h>
 #include <errno.h>
 #include <malloc.h>
+#include <unistd.h>
 #include <string.h>
 
 #include "../include/lib.h"
+#include "../include/cache.h"
 
-#include "../include/dol.h"
 #include "../include/dolrel.h"
+#include "../include/cubeboot.h"
 
 #define _GNU_SOURCE
 #include <getopt.h>
 
-#define UDOLREL_VERSION "V0.1-20060310"
+/* cached results are keyed on it, bump it when the output changes */
+#define UDOLREL_VERSION "V0.2-20261017"
 
 const char *__progname;
 
-const unsigned int max_nr_sections = DOL_SECT_MAX_TEXT + DOL_SECT_MAX_DATA;
-struct dolrel_control control;
-struct dolrel_section sections[DOL_SECT_MAX_TEXT + DOL_SECT_MAX_DATA];
-
-void *reloc_code;
-unsigned int reloc_code_size;
-unsigned long reloc_flags;
-
-#define DOL_ALIGN_SHIFT  5
-#define DOL_ALIGN_SIZE   (1UL << DOL_ALIGN_SHIFT)
-#define DOL_ALIGN_MASK   (~((1 << DOL_ALIGN_SHIFT) - 1))
-
-#define dol_align(addr)  (void *) \
-                        ((((unsigned long)(addr)) + \
-                                 DOL_ALIGN_SIZE - 1) & DOL_ALIGN_MASK)
-
 /**
  *
  */
-void calc_section_sizes(struct dol_header *dh, uint32_t *largest, uint32_t *total)
+static void print_area(const char *what, uint32_t start, uint32_t end)
 {
-	int k;
-	uint32_t sect_size;
-
-	*largest = 0;
-	*total = 0;
-
-	for( k = 0; k < max_nr_sections; k++) {
-		sect_size = be32_to_cpu(dol_sect_size(dh, k));
-		*total += sect_size;
-		if (sect_size > *largest)
-			*largest = sect_size;
-	}
+	if (start != end)
+		fprintf(stderr, "  %08x-%08x %8u  %s\n", start, end,
+			end - start, what);
 }
 
 /**
  *
  */
-int pad(FILE *f, size_t count)
+void print_map(struct cb_dolrel_map *map)
 {
-	uint8_t data = 0xaa;
-	size_t nr_items;
-
-        while (count--) {
-		nr_items = fwrite(&data, 1, 1, f);
-		if (nr_items != 1)
-			return -1;
+	struct cb_dolrel_step *step;
+	int i;
+
+	fprintf(stderr, "memory map:\n");
+	print_area("relocation engine", map->engine_start, map->engine_end);
+	print_area("engine stack", map->stack_start, map->stack_end);
+	print_area("packed sections", map->data_start, map->data_end);
+	print_area("bss", map->bss_start, map->bss_end);
+
+	fprintf(stderr, "relocation plan:\n");
+	for (i = 0; i < map->nr_steps; i++) {
+		step = &map->steps[i];
+		if (step->flags & DOLREL_SECTION_ZERO) {
+			fprintf(stderr, "  %08x-%08x %8u  clear\n",
+				step->dst, step->dst + step->length,
+				step->length);
+			continue;
+		}
+		fprintf(stderr, "  %08x-%08x %8u  %s %s from %08x-%08x\n",
+			step->dst, step->dst + step->length, step->length,
+			(step->packed_length == step->length) ?
+			"copy" : "unpack",
+			(step->flags & DOLREL_SECTION_TEXT) ? "text" : "data",
+			step->src, step->src + step->packed_length);
 	}
-	return 0;
+	fprintf(stderr, "entry point %08x\n", map->entry_point);
 }
 
 /**
  *
  */
-int transform_dol(FILE *fout, FILE *fin)
+void relocate_dol(int fd, FILE *fin, const char *infile,
+		  struct mapped_file *engine, struct cb_dolrel_options *options,
+		  int show_map)
 {
-	struct dol_header dol_header, *dol;
-	struct dol_header new_dol_header, *new_dol;
-	struct dolrel_section *reloc_entry;
-	unsigned int nr_reloc_entries;
-	uint32_t largest_sect_size, total_sects_size, code_size, len;
-	uint32_t aligned_total_sects_size, aligned_code_size;
-	void *sect_buf;
-	unsigned int sects_bitmap;
-	unsigned long load_address_code, load_address_data;
-	unsigned long lowest_start;
-	size_t nr_items;
-	int i, j, k;
-	int result;
-
-	/* retrieve the original .dol header */
-	dol = &dol_header;
-	nr_items= fread(dol, sizeof(*dol), 1, fin);
-	if (nr_items != 1) {
-		die("can't read dol header: %s\n", strerror(errno));
-	}
-
-#if 0
-	if (dol_check_header(dol)) {
-		
+	struct cb_dolrel_map map;
+	struct mapped_file dol;
+	void *buf, *scratch;
+	size_t size;
+	int error;
+
+	map_fd(fileno(fin), infile, &dol);
+
+	/* the first call just tells the size of the result */
+	error = cb_dolrel(dol.data, dol.size, engine->data, engine->size,
+			  options, NULL, 0, &size);
+	if (error != CB_ENOSPC)
+		die("%s: can't relocate: %s\n", infile, cb_strerror(error));
+
+	buf = xmalloc(size);
+	error = cb_dolrel(dol.data, dol.size, engine->data, engine->size,
+			  options, buf, size, &size);
+	if (error)
+		die("%s: can't relocate: %s\n", infile, cb_strerror(error));
+
+	/* make sure the engine will get the original sections back */
+	scratch = xmalloc(CB_MEM1_SIZE);
+	error = cb_dolrel_check(buf, size, engine->size, dol.data, dol.size,
+				scratch, CB_MEM1_SIZE);
+	if (error)
+		die("%s: relocated dol doesn't unpack: %s\n", infile,
+		    cb_strerror(error));
+	free(scratch);
+
+	if (show_map) {
+		error = cb_dolrel_map(buf, size, engine->size, &map);
+		if (error)
+			die("%s: can't map relocated dol: %s\n", infile,
+			    cb_strerror(error));
+		print_map(&map);
 	}
-#endif
 
-	/* pretty self explanatory */
-	calc_section_sizes(dol, &largest_sect_size, &total_sects_size);
-	aligned_total_sects_size = (uint32_t)dol_align(total_sects_size);
-
-	/* allocate a buffer large enough for the largest section */
-	sect_buf = malloc(largest_sect_size);
-	if (!sect_buf) {
-		die("can't allocate section buffer: %s\n", strerror(errno));
-	}
-
-	sects_bitmap = (1 << max_nr_sections) - 1;
-	memset(sections, 0, sizeof(sections));
-	reloc_entry = &sections[0];
-	nr_reloc_entries = 0;
-
-	/* calculate the final stub size */
-	code_size = reloc_code_size + sizeof(control) + sizeof(sections);
-	aligned_code_size = (uint32_t)dol_align(code_size);
-
-	/*
-	 * The resulting .dol will contain just a data and a text section.
-	 */
-
-	/* the relocation stub will be loaded at this address */
-	load_address_code = 0x80003100;
-
-	/* the original sections will be loaded right after the stub */
-	load_address_data = load_address_code + aligned_code_size;
-
-	/* this is the new .dol header */
-	new_dol = &new_dol_header;
-	memset(new_dol, 0, sizeof(*new_dol));
-
-	/*
-	 * The data section contains all original sections packed one after
-	 * another.
-	 */
-	new_dol->address_text[0] = cpu_to_be32(load_address_data);
-	new_dol->offset_text[0] = cpu_to_be32(sizeof(*new_dol));
-	new_dol->size_text[0] = cpu_to_be32(aligned_total_sects_size);
-
-	/*
-	 * The text section contains the relocation stub and the control
-	 * structures.
-	 */
-	new_dol->address_text[1] = cpu_to_be32(load_address_code);
-	new_dol->offset_text[1] = cpu_to_be32(be32_to_cpu(new_dol->offset_text[0]) + be32_to_cpu(new_dol->size_text[0]));
-	new_dol->size_text[1] = cpu_to_be32(aligned_code_size);
-
-	/* we don't need a bss section here */
-	new_dol->size_bss = 0;
-	new_dol->address_bss = 0;
-
-	/* our entry point becomes our relocation stub */
-	new_dol->entry_point = cpu_to_be32(load_address_code);
-
-	/* write the new .dol header */
-	nr_items = fwrite(new_dol, sizeof(*new_dol), 1, fout);
-	if (nr_items != 1) {
-		die("can't write dol header: %s\n", strerror(errno));
-	}
-
-	/* write all sections into the new .dol data section */
-	while(sects_bitmap) {
-		lowest_start = 0xffffffff;
-		for (j = -1, k = 0; k < max_nr_sections; k++) {
-			/* continue if section is already done */
-			if ((sects_bitmap & (1 << k)) == 0)
-				continue;
-
-			/* mark section as done if empty */
-			if (be32_to_cpu(dol_sect_size(dol, k)) == 0) {
-				sects_bitmap &= ~(1 << k);
-				continue;
-			}
-
-			/* found new candidate */
-			if (be32_to_cpu(dol_sect_address(dol, k)) < lowest_start) {
-				lowest_start = be32_to_cpu(dol_sect_address(dol, k));
-				j = k;
-			}
-		}
-
-		/* mark section as being loaded */
-		sects_bitmap &= ~(1 << j);
-
-		result = fseek(fin, be32_to_cpu(dol_sect_offset(dol, j)),
-			       SEEK_SET);
-		if (result < 0) {
-			die("can't seek to section: %s\n", strerror(errno));
-		}
-
-		len = be32_to_cpu(dol_sect_size(dol, j));
-		nr_items = fread(sect_buf, len, 1, fin);
-		if (nr_items != 1) {
-			die("can't read section: %s\n", strerror(errno));
-		}
+	if (write_full(fd, buf, size) < 0)
+		die("can't write relocated dol: %s\n", strerror(errno));
 
-		nr_items = fwrite(sect_buf, len, 1, fout);
-		if (nr_items != 1) {
-			die("can't write section: %s\n", strerror(errno));
-		}
-
-		reloc_entry->dst_address = (void *)dol_sect_address(dol, j);
-		reloc_entry->length = cpu_to_be32(len);
-		reloc_entry++;
-		nr_reloc_entries++;
-	}
-
-	/* data section padding */
-	result = pad(fout, aligned_total_sects_size - total_sects_size);
-	if (result) {
-		die("can't write data section padding: %s\n", strerror(errno));
-	}
-	
-	/* write our stub into the new .dol code section */
-
-	/* stub code */
-	nr_items = fwrite(reloc_code, reloc_code_size, 1, fout);
-	if (nr_items != 1) {
-		die("can't write relocation code: %s\n", strerror(errno));
-	}
-
-	/* stub control header */
-	control.version = cpu_to_be32(0xdead0001);
-
-	control.flags = cpu_to_be32(reloc_flags);
-
-	control.entry_point = (void *)dol->entry_point;
-	control.address_bss = (void *)dol->address_bss;
-	control.size_bss = dol->size_bss;
-	control.src_address = (void *)cpu_to_be32(load_address_data);
-
-	control.nr_sections = cpu_to_be32(nr_reloc_entries);
-
-	nr_items = fwrite(&control, sizeof(control), 1, fout);
-	if (nr_items != 1) {
-		die("can't write relocation control: %s\n", strerror(errno));
-	}
-
-	/* stub relocation table */
-	nr_items = fwrite(sections, sizeof(sections), 1, fout);
-	if (nr_items != 1) {
-		die("can't write relocation table: %s\n", strerror(errno));
-	}
-
-	/* code section padding */
-	result = pad(fout, aligned_code_size - code_size);
-	if (result) {
-		die("can't write text section padding: %s\n", strerror(errno));
-	}
+	free(buf);
+	unmap_file(&dol);
 }
 
 /**
@@ -298,6 +157,16 @@ void usage(void)
 						"\n"
                 "  -x, --disable-xenogc    disable xenogc on startup"
 						" (implies -s)" "\n"
+                "  -c, --compress          compress the dol sections" "\n"
+                "  -p, --placement=WHERE   stage the sections as low or"
+						" as high as possible" "\n"
+                "                          (low or high, default low)"
+						"\n"
+                "  -z, --zero-run=SIZE     clear zero runs this long"
+						" instead of storing them" "\n"
+                "                          (default 4096, 0 for never)"
+						"\n"
+                "  -m, --map               print the memory map" "\n"
                 "  -r, --releng=PATH       relocation engine image"
 						" (default sdre.bin)" "\n"
                 "  -o, --outfile=PATH      output file (default stdout)" "\n"
@@ -313,8 +182,11 @@ int main(int argc, char *argv[])
 	char *outfile = NULL, *infile = NULL;
 	FILE *fout, *fin;
 	char *sdre_bin = "sdre.bin";
-	void *sdre_image;
-	off_t sdre_size;
+	struct mapped_file sdre;
+	struct cb_dolrel_options options;
+	struct cache_key key;
+	int use_cache = 0;
+	int show_map = 0;
         char *p;
 	int ch;
 	int result;
@@ -322,27 +194,51 @@ int main(int argc, char *argv[])
         struct option long_options[] = {
                 {"stop-motor", 0, NULL, 's'},
                 {"disable-xenogc", 0, NULL, 'x'},
+                {"compress", 0, NULL, 'c'},
+                {"placement", 1, NULL, 'p'},
+                {"zero-run", 1, NULL, 'z'},
+                {"map", 0, NULL, 'm'},
                 {"releng", 1, NULL, 'r'},
                 {"outfile", 1, NULL, 'o'},
                 {"version", 0, NULL, 'v'},
                 {"help", 0, NULL, 'h'},
                 {0,0,0,0}
         };
-#define SHORT_OPTIONS "sxr:o:vh"
+#define SHORT_OPTIONS "sxcp:z:mr:o:vh"
 
         p = strrchr(argv[0], '/');
         __progname = (p && p[1]) ? p+1 : argv[0];
 
-	reloc_flags = 0;
+	memset(&options, 0, sizeof(options));
+	options.zero_run = CB_DOLREL_ZERO_RUN;
 
        while((ch = getopt_long(argc, argv, SHORT_OPTIONS,
                                 long_options, NULL)) != -1) {
                 switch(ch) {
 			case 's':
-				reloc_flags |= DOLREL_FLAG_STOP_MOTOR;
+				options.flags |= DOLREL_FLAG_STOP_MOTOR;
 				break;
  			case 'x':
-				reloc_flags |= DOLREL_FLAG_DISABLE_XENOGC;
+				options.flags |= DOLREL_FLAG_DISABLE_XENOGC;
+				break;
+			case 'c':
+				options.compress = 1;
+				break;
+			case 'p':
+				if (!strcmp(optarg, "low"))
+					options.placement = CB_PLACE_LOW;
+				else if (!strcmp(optarg, "high"))
+					options.placement = CB_PLACE_HIGH;
+				else
+					usage();
+				break;
+			case 'z':
+				options.zero_run = strtoul(optarg, &p, 0);
+				if (!*optarg || *p)
+					usage();
+				break;
+			case 'm':
+				show_map = 1;
 				break;
 			case 'r':
 				sdre_bin = optarg;
@@ -391,6 +287,29 @@ int main(int argc, char *argv[])
 			outfile = "*stdout*";
 			fout = stdout;
 		} else {
+			/*
+			 * input from a pipe can't be hashed in advance,
+			 * and the map is only known when relocating
+			 */
+			use_cache = (fin != stdin && !show_map);
+			if (use_cache) {
+				cache_key_init(&key, "udolrel", UDOLREL_VERSION);
+				cache_key_add_string(&key, cb_build_id());
+				cache_key_add(&key, &options.flags,
+					      sizeof(options.flags));
+				cache_key_add(&key, &options.compress,
+					      sizeof(options.compress));
+				cache_key_add(&key, &options.placement,
+					      sizeof(options.placement));
+				cache_key_add(&key, &options.zero_run,
+					      sizeof(options.zero_run));
+				cache_key_add_file(&key, sdre_bin);
+				cache_key_add_file(&key, infile);
+				if (cache_fetch(&key, outfile)) {
+					cache_report(stderr);
+					return 0;
+				}
+			}
 			fout = fopen(outfile, "w");
 			if (!fout) {
 				die("%s: can't open output file: %s\n",
@@ -399,14 +318,19 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	sdre_image = slurp_file(sdre_bin, &sdre_size);
+	map_file(sdre_bin, &sdre);
 
-	reloc_code_size = sdre_size - sizeof(struct dolrel_control);
-	reloc_code = sdre_image;
+	relocate_dol(fileno(fout), fin, infile, &sdre, &options, show_map);
 
-	transform_dol(fout, fin);
-
-	fclose(fout);
+	if (fclose(fout))
+		die("%s: can't close output file: %s\n", outfile,
+		    strerror(errno));
 	fclose(fin);
+	unmap_file(&sdre);
+
+	if (use_cache) {
+		cache_store(&key, outfile);
+		cache_report(stderr);
+	}
 }
 